@@ -59,6 +59,13 @@ extern int isinfd64(_Decimal64);
 # define UNLIKELY(_x)	__builtin_expect((_x), 0)
 #endif	/* UNLIKELY */
 
+#if !defined countof
+# define countof(x)	(sizeof(x) / sizeof(*x))
+#endif	/* !countof */
+
+/* number of fields the batch converters stage at once */
+#define NBATCH	(16U)
+
 #define _paste(x, y)	x ## y
 #define paste(x, y)	_paste(x, y)
 
@@ -290,6 +297,27 @@ unpack_declet(unsigned int x)
 	return res;
 }
 
+#if defined HAVE_DFP754_DPD_LITERALS
+static inline __attribute__((pure, const)) unsigned int
+declet2bin(unsigned int x)
+{
+/* declet X to binary 0 to 999 */
+	x = unpack_declet(x);
+	return (x >> 8U) * 100U + ((x >> 4U) & 0xfU) * 10U + (x & 0xfU);
+}
+
+static inline __attribute__((pure, const)) uint_least32_t
+bin_dpd32(uint_least32_t m)
+{
+/* turn a dpd mantissa T MH ML into its binary coefficient */
+	uint_least32_t r = (m >> 20U) & 0xfU;
+
+	r = r * 1000U + declet2bin((m >> 10U) & 0x3ffU);
+	r = r * 1000U + declet2bin((m >> 0U) & 0x3ffU);
+	return r;
+}
+#endif	/* HAVE_DFP754_DPD_LITERALS */
+
 static _Decimal32
 assemble_bid(uint32_t m, uint32_t ex, uint32_t s)
 {
@@ -422,46 +450,96 @@ strtobcd32(const char *src, char **on)
 	return (bcd32_t){mant, expo, sign};
 }
 
-static size_t
-bcd32tostr(char *restrict buf, size_t bsz, uint_least32_t mant, int e, int s)
+static const char dig2[200U] =
+	"00010203040506070809" "10111213141516171819"
+	"20212223242526272829" "30313233343536373839"
+	"40414243444546474849" "50515253545556575859"
+	"60616263646566676869" "70717273747576777879"
+	"80818283848586878889" "90919293949596979899";
+
+static const uint_least32_t p10[10U] = {
+	1U, 10U, 100U, 1000U, 10000U, 100000U,
+	1000000U, 10000000U, 100000000U, 1000000000U,
+};
+
+static inline __attribute__((pure, const)) unsigned int
+ndig32(uint_least32_t m)
 {
-	char *restrict bp = buf;
-	const char *const ep = buf + bsz;
+/* number of decimal digits in M, at least 1 */
+	unsigned int n = ((32U - __builtin_clz(m | 1U)) * 1233U) >> 12U;
+	n += m >= p10[n];
+	return n + !n;
+}
 
-	/* write the right-of-point side first */
-	for (; e < 0 && bp < ep; e++, mant >>= 4U) {
-		*bp++ = C(mant & 0b1111U);
-	}
-	/* write point now */
-	if (bp > buf && bp < ep) {
-		*bp++ = '.';
+static inline void
+putdig32(char *restrict ep, uint_least32_t m, unsigned int nd)
+{
+/* write the ND least significant digits of M so they end just before EP */
+	for (; nd >= 2U; nd -= 2U, m /= 100U) {
+		ep -= 2U;
+		memcpy(ep, dig2 + 2U * (m % 100U), 2U);
 	}
-	/* write trailing 0s for left-of-point side */
-	for (; e > 0 && bp < ep; e--) {
-		*bp++ = '0';
+	if (nd) {
+		*--ep = C(m % 10U);
 	}
-	/* now write the rest of the mantissa */
-	if (LIKELY(mant)) {
-		for (; mant && bp < ep; mant >>= 4U) {
-			*bp++ = C(mant & 0b1111U);
+	return;
+}
+
+static inline __attribute__((always_inline)) size_t
+fixtostr(char *restrict buf, size_t bsz, uint_least32_t m, unsigned int k, int s)
+{
+/* write M * 10^-K, i.e. with exactly K digits right of the point */
+	const uint_least32_t ip = k < countof(p10) ? m / p10[k] : 0U;
+	const uint_least32_t fp = k < countof(p10) ? m % p10[k] : m;
+	const unsigned int ni = ndig32(ip);
+	const size_t len = s + ni + 1U + k;
+
+	if (UNLIKELY(len > bsz)) {
+		return 0U;
+	}
+	buf[0U] = '-';
+	putdig32(buf + s + ni, ip, ni);
+	buf[s + ni] = '.';
+	putdig32(buf + len, fp, k);
+	if (len < bsz) {
+		buf[len] = '\0';
+	}
+	return len;
+}
+
+static size_t
+bin32tostr(char *restrict buf, size_t bsz, uint_least32_t m, int e, int s)
+{
+/* write (-1)^S * M * 10^E, M being the binary coefficient */
+	unsigned int nd;
+	size_t len;
+
+	switch (e) {
+	case -5:
+		/* usual suspects, let the compiler turn the divisions
+		 * into multiplications */
+		return fixtostr(buf, bsz, m, 5U, s);
+	case -6:
+		return fixtostr(buf, bsz, m, 6U, s);
+	default:
+		if (e < 0) {
+			return fixtostr(buf, bsz, m, (unsigned int)-e, s);
 		}
-	} else if (bp < ep) {
-		/* put a leading 0 */
-		*bp++ = '0';
-	}
-	if (s && bp < ep) {
-		*bp++ = '-';
+		break;
 	}
-	if (bp < ep) {
-		*bp = '\0';
+	nd = ndig32(m);
+	len = s + nd + e;
+	if (UNLIKELY(len > bsz)) {
+		return 0U;
 	}
-	/* reverse the string */
-	for (char *ip = buf, *jp = bp - 1; ip < jp; ip++, jp--) {
-		char tmp = *ip;
-		*ip = *jp;
-		*jp = tmp;
+	buf[0U] = '-';
+	putdig32(buf + s + nd, m, nd);
+	/* trailing 0s for left-of-point side */
+	memset(buf + s + nd, '0', e);
+	if (len < bsz) {
+		buf[len] = '\0';
 	}
-	return bp - buf;
+	return len;
 }
 
 #if defined HAVE_DFP754_BID_LITERALS
@@ -633,6 +711,38 @@ strtod32(const char *src, char **on)
 }
 #endif	/* !HAVE_STRTOD32 || !HAVE_CLEAN_STRTOD32 */
 
+size_t
+strtod32s(_Decimal32 *restrict tgt, const char *str, const size_t *off, size_t n)
+{
+	size_t r = 0U;
+
+	for (size_t i = 0U; i < n; i += NBATCH) {
+		const size_t k = min_z(NBATCH, n - i);
+		bcd32_t b[NBATCH];
+		unsigned int ok[NBATCH];
+
+		/* scan all fields of this batch first */
+		for (size_t j = 0U; j < k; j++) {
+			const char *sp = str + off[i + j];
+			char *on;
+
+			b[j] = strtobcd32(sp, &on);
+			ok[j] = on > sp && on <= str + off[i + j + 1U];
+			r += ok[j];
+		}
+		/* assemble them in one go, no more branching on the input */
+		for (size_t j = 0U; j < k; j++) {
+#if defined HAVE_DFP754_BID_LITERALS
+			const _Decimal32 x = bcd32tobid(b[j]);
+#elif defined HAVE_DFP754_DPD_LITERALS
+			const _Decimal32 x = bcd32todpd(b[j]);
+#endif	/* HAVE_DFP754_*_LITERALS */
+			tgt[i + j] = ok[j] ? x : NAND32;
+		}
+	}
+	return r;
+}
+
 #if defined HAVE_DFP754_BID_LITERALS
 static int
 bid32tostr(char *restrict buf, size_t bsz, _Decimal32 x)
@@ -647,19 +757,9 @@ bid32tostr(char *restrict buf, size_t bsz, _Decimal32 x)
 	/* get the exponent, sign and mantissa */
 	e = quantexpbid32(x);
 	m = mant_bid32(x);
-	s = m ? sign_bid32(x) : 0/*no stinking signed naughts*/;
-
-	/* reencode m as bcd */
-	with (uint_least32_t bcdm = 0U) {
-		for (size_t i = 0; i < 7U; i++, bcdm >>= 4U) {
-			uint_least32_t digit;
+	s = m ? -sign_bid32(x) : 0/*no stinking signed naughts*/;
 
-			digit = m % 10U, m /= 10U;
-			bcdm ^= digit << 28U;
-		}
-		m = bcdm;
-	}
-	return (int)bcd32tostr(buf, bsz, m, e, s);
+	return (int)bin32tostr(buf, bsz, m, e, s);
 }
 #elif defined HAVE_DFP754_DPD_LITERALS
 static int
@@ -675,21 +775,13 @@ dpd32tostr(char *restrict buf, size_t bsz, _Decimal32 x)
 	/* get the exponent, sign and mantissa */
 	e = quantexpdpd32(x);
 	if (LIKELY((m = mant_dpd32(x)))) {
-		uint_least32_t b;
-
-		s = sign_dpd32(x);
-		/* get us a proper bcd version of M */
-		b = (m & 0x00f00000U);
-		b >>= 8U;
-		b |= unpack_declet((m >> 10U) & 0x3ffU);
-		b <<= 12U;
-		b |= unpack_declet((m >> 0U) & 0x3ffU);
-		m = b;
+		s = -sign_dpd32(x);
+		m = bin_dpd32(m);
 	} else {
-		/* no stinking signed 0s and m is in bcd form already */
+		/* no stinking signed 0s */
 		s = 0;
 	}
-	return bcd32tostr(buf, bsz, m, e, s);
+	return (int)bin32tostr(buf, bsz, m, e, s);
 }
 #endif	/* HAVE_DFP754_BID_LITERALS || HAVE_DFP754_DPD_LITERALS */
 
@@ -702,8 +794,7 @@ d32tostr(char *restrict buf, size_t bsz, _Decimal32 x)
 		return z;
 	} else if (UNLIKELY(isinfd32(x))) {
 		const size_t z = min_z(3U + (x < 0.df), bsz);
-		buf[0U] = '-';
-		memcpy(buf + (x < 0.df), "inf", z);
+		memcpy(buf, "-inf" + !(x < 0.df), z);
 		return z;
 	}
 #if defined HAVE_DFP754_BID_LITERALS
@@ -713,6 +804,62 @@ d32tostr(char *restrict buf, size_t bsz, _Decimal32 x)
 #endif	 /* HAVE_DFP754_*_LITERALS */
 }
 
+size_t
+d32tostrs(char *restrict buf, size_t bsz, size_t *restrict off,
+	    const _Decimal32 *src, size_t n, char sep)
+{
+	size_t len = 0U;
+	size_t i;
+
+	for (i = 0U; i < n; i += NBATCH) {
+		const size_t k = min_z(NBATCH, n - i);
+		uint_least32_t m[NBATCH];
+		int e[NBATCH];
+		int s[NBATCH];
+		unsigned int x[NBATCH];
+
+		/* decompose the whole batch first, this is pure bit
+		 * fiddling and doesn't depend on the output */
+		for (size_t j = 0U; j < k; j++) {
+			const _Decimal32 v = src[i + j];
+
+			/* nans and infs have combination field 1111x */
+			x[j] = (bits32(v) & 0x78000000U) == 0x78000000U;
+#if defined HAVE_DFP754_BID_LITERALS
+			e[j] = quantexpbid32(v);
+			m[j] = mant_bid32(v);
+			s[j] = m[j] ? -sign_bid32(v) : 0;
+#elif defined HAVE_DFP754_DPD_LITERALS
+			e[j] = quantexpdpd32(v);
+			m[j] = bin_dpd32(mant_dpd32(v));
+			s[j] = m[j] ? -sign_dpd32(v) : 0;
+#endif	/* HAVE_DFP754_*_LITERALS */
+		}
+		/* now write them */
+		for (size_t j = 0U; j < k; j++) {
+			size_t z;
+
+			off[i + j] = len;
+			if (UNLIKELY(x[j])) {
+				z = d32tostr(buf + len, bsz - len, src[i + j]);
+			} else {
+				z = bin32tostr(buf + len, bsz - len, m[j], e[j], s[j]);
+			}
+			if (UNLIKELY(!z || len + z >= bsz)) {
+				/* no room for the value and its separator */
+				i += j;
+				goto out;
+			}
+			len += z;
+			buf[len++] = sep;
+		}
+	}
+	i = n;
+out:
+	off[i] = len;
+	return i;
+}
+
 
 /* always use our own version,
  * the official version would return NAN in case the significand's
@@ -752,4 +899,21 @@ decompd32(_Decimal32 x)
 #endif	/* HAVE_DFP754_*_LITERALS */
 }
 
+int_least32_t
+coefd32(int *e, _Decimal32 x)
+{
+	int_least32_t r;
+
+#if defined HAVE_DFP754_BID_LITERALS
+	*e = quantexpbid32(x);
+	r = mant_bid32(x);
+	r = sign_bid32(x) ? -r : r;
+#elif defined HAVE_DFP754_DPD_LITERALS
+	*e = quantexpdpd32(x);
+	r = bin_dpd32(mant_dpd32(x));
+	r = sign_dpd32(x) ? -r : r;
+#endif	/* HAVE_DFP754_*_LITERALS */
+	return r;
+}
+
 /* dfp754_d32.c ends here */
@@ -62,9 +62,24 @@ typedef struct {
 
 extern _Decimal32 strtod32(const char*, char**);
 
+/**
+ * Parse N decimals from STR, the I-th one living in [OFF[I], OFF[I + 1]).
+ * Results go to TGT, fields that aren't numbers become NaN.
+ * Return the number of fields that could be read. */
+extern size_t strtod32s(_Decimal32 *restrict tgt,
+			const char *str, const size_t *off, size_t n);
+
 #if defined HAVE_DFP754_BID_LITERALS || defined HAVE_DFP754_DPD_LITERALS
 extern int d32tostr(char *restrict buf, size_t bsz, _Decimal32);
 
+/**
+ * Write N decimals from SRC to BUF, each one followed by SEP.
+ * The I-th value starts at BUF + OFF[I], OFF[N] is the total length.
+ * Return the number of values that fit into BSZ bytes, if that's
+ * less than N then OFF[return value] is the length written. */
+extern size_t d32tostrs(char *restrict buf, size_t bsz, size_t *restrict off,
+		       const _Decimal32 *src, size_t n, char sep);
+
 /**
  * Round X to the quantum of R. */
 extern _Decimal32 quantized32(_Decimal32 x, _Decimal32 r);
@@ -79,6 +94,11 @@ extern _Decimal32 scalbnd32(_Decimal32 x, int n);
  * Decompose x. */
 extern bcd32_t decompd32(_Decimal32 x);
 
+/**
+ * Return the coefficient of X as signed binary integer and put
+ * the exponent of X into *E. */
+extern int_least32_t coefd32(int *e, _Decimal32 x);
+
 
 inline __attribute__((pure, const)) uint32_t bits32(_Decimal32 x);
 inline __attribute__((pure, const)) _Decimal32 bobs32(uint32_t u);
@@ -59,6 +59,13 @@ extern int isinfd64(_Decimal64);
 # define UNLIKELY(_x)	__builtin_expect((_x), 0)
 #endif	/* UNLIKELY */
 
+#if !defined countof
+# define countof(x)	(sizeof(x) / sizeof(*x))
+#endif	/* !countof */
+
+/* number of fields the batch converters stage at once */
+#define NBATCH	(16U)
+
 #define _paste(x, y)	x ## y
 #define paste(x, y)	_paste(x, y)
 
@@ -290,6 +297,30 @@ unpack_declet(unsigned int x)
 	return res;
 }
 
+#if defined HAVE_DFP754_DPD_LITERALS
+static inline __attribute__((pure, const)) unsigned int
+declet2bin(unsigned int x)
+{
+/* declet X to binary 0 to 999 */
+	x = unpack_declet(x);
+	return (x >> 8U) * 100U + ((x >> 4U) & 0xfU) * 10U + (x & 0xfU);
+}
+
+static inline __attribute__((pure, const)) uint_least64_t
+bin_dpd64(uint_least64_t m)
+{
+/* turn a dpd mantissa TTT MH ML into its binary coefficient */
+	uint_least64_t r = m >> 50U;
+
+	r = r * 1000U + declet2bin((m >> 40U) & 0x3ffU);
+	r = r * 1000U + declet2bin((m >> 30U) & 0x3ffU);
+	r = r * 1000U + declet2bin((m >> 20U) & 0x3ffU);
+	r = r * 1000U + declet2bin((m >> 10U) & 0x3ffU);
+	r = r * 1000U + declet2bin((m >> 0U) & 0x3ffU);
+	return r;
+}
+#endif	/* HAVE_DFP754_DPD_LITERALS */
+
 static _Decimal64
 assemble_bid(uint64_t m, uint64_t ex, uint64_t s)
 {
@@ -433,46 +464,100 @@ strtobcd64(const char *src, char **on)
 	return (bcd64_t){mant, expo, sign};
 }
 
-static size_t
-bcd64tostr(char *restrict buf, size_t bsz, bcd64_t b)
+static const char dig2[200U] =
+	"00010203040506070809" "10111213141516171819"
+	"20212223242526272829" "30313233343536373839"
+	"40414243444546474849" "50515253545556575859"
+	"60616263646566676869" "70717273747576777879"
+	"80818283848586878889" "90919293949596979899";
+
+static const uint_least64_t p10[20U] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL,
+	1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+	10000000000ULL, 100000000000ULL, 1000000000000ULL,
+	10000000000000ULL, 100000000000000ULL, 1000000000000000ULL,
+	10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+static inline __attribute__((pure, const)) unsigned int
+ndig64(uint_least64_t m)
 {
-	char *restrict bp = buf;
-	const char *const ep = buf + bsz;
+/* number of decimal digits in M, at least 1 */
+	unsigned int n = ((64U - __builtin_clzll(m | 1U)) * 1233U) >> 12U;
+	n += m >= p10[n];
+	return n + !n;
+}
 
-	/* write the right-of-point side first */
-	for (; b.expo < 0 && bp < ep; b.expo++, b.mant >>= 4U) {
-		*bp++ = C(b.mant & 0b1111U);
-	}
-	/* write point now */
-	if (bp > buf && bp < ep) {
-		*bp++ = '.';
+static inline void
+putdig64(char *restrict ep, uint_least64_t m, unsigned int nd)
+{
+/* write the ND least significant digits of M so they end just before EP */
+	for (; nd >= 2U; nd -= 2U, m /= 100U) {
+		ep -= 2U;
+		memcpy(ep, dig2 + 2U * (m % 100U), 2U);
 	}
-	/* write trailing 0s for left-of-point side */
-	for (; b.expo > 0 && bp < ep; b.expo--) {
-		*bp++ = '0';
+	if (nd) {
+		*--ep = C(m % 10U);
 	}
-	/* now write the rest of the mantissa */
-	if (LIKELY(b.mant)) {
-		for (; b.mant && bp < ep; b.mant >>= 4U) {
-			*bp++ = C(b.mant & 0b1111U);
+	return;
+}
+
+static inline __attribute__((always_inline)) size_t
+fixtostr(char *restrict buf, size_t bsz, uint_least64_t m, unsigned int k, int s)
+{
+/* write M * 10^-K, i.e. with exactly K digits right of the point */
+	const uint_least64_t ip = k < countof(p10) ? m / p10[k] : 0U;
+	const uint_least64_t fp = k < countof(p10) ? m % p10[k] : m;
+	const unsigned int ni = ndig64(ip);
+	const size_t len = s + ni + 1U + k;
+
+	if (UNLIKELY(len > bsz)) {
+		return 0U;
+	}
+	buf[0U] = '-';
+	putdig64(buf + s + ni, ip, ni);
+	buf[s + ni] = '.';
+	putdig64(buf + len, fp, k);
+	if (len < bsz) {
+		buf[len] = '\0';
+	}
+	return len;
+}
+
+static size_t
+bin64tostr(char *restrict buf, size_t bsz, uint_least64_t m, int e, int s)
+{
+/* write (-1)^S * M * 10^E, M being the binary coefficient */
+	unsigned int nd;
+	size_t len;
+
+	switch (e) {
+	case -5:
+		/* usual suspects, let the compiler turn the divisions
+		 * into multiplications */
+		return fixtostr(buf, bsz, m, 5U, s);
+	case -6:
+		return fixtostr(buf, bsz, m, 6U, s);
+	default:
+		if (e < 0) {
+			return fixtostr(buf, bsz, m, (unsigned int)-e, s);
 		}
-	} else if (bp < ep) {
-		/* put a leading 0 */
-		*bp++ = '0';
-	}
-	if (b.sign && bp < ep) {
-		*bp++ = '-';
+		break;
 	}
-	if (bp < ep) {
-		*bp = '\0';
+	nd = ndig64(m);
+	len = s + nd + e;
+	if (UNLIKELY(len > bsz)) {
+		return 0U;
 	}
-	/* reverse the string */
-	for (char *ip = buf, *jp = bp - 1; ip < jp; ip++, jp--) {
-		char tmp = *ip;
-		*ip = *jp;
-		*jp = tmp;
+	buf[0U] = '-';
+	putdig64(buf + s + nd, m, nd);
+	/* trailing 0s for left-of-point side */
+	memset(buf + s + nd, '0', e);
+	if (len < bsz) {
+		buf[len] = '\0';
 	}
-	return bp - buf;
+	return len;
 }
 
 #if defined HAVE_DFP754_BID_LITERALS
@@ -652,6 +737,38 @@ strtod64(const char *src, char **on)
 }
 #endif	/* !HAVE_STRTOD64 || !HAVE_CLEAN_STRTOD64 */
 
+size_t
+strtod64s(_Decimal64 *restrict tgt, const char *str, const size_t *off, size_t n)
+{
+	size_t r = 0U;
+
+	for (size_t i = 0U; i < n; i += NBATCH) {
+		const size_t k = min_z(NBATCH, n - i);
+		bcd64_t b[NBATCH];
+		unsigned int ok[NBATCH];
+
+		/* scan all fields of this batch first */
+		for (size_t j = 0U; j < k; j++) {
+			const char *sp = str + off[i + j];
+			char *on;
+
+			b[j] = strtobcd64(sp, &on);
+			ok[j] = on > sp && on <= str + off[i + j + 1U];
+			r += ok[j];
+		}
+		/* assemble them in one go, no more branching on the input */
+		for (size_t j = 0U; j < k; j++) {
+#if defined HAVE_DFP754_BID_LITERALS
+			const _Decimal64 x = bcd64tobid(b[j]);
+#elif defined HAVE_DFP754_DPD_LITERALS
+			const _Decimal64 x = bcd64todpd(b[j]);
+#endif	/* HAVE_DFP754_*_LITERALS */
+			tgt[i + j] = ok[j] ? x : NAND64;
+		}
+	}
+	return r;
+}
+
 
 #if defined HAVE_DFP754_BID_LITERALS
 static int
@@ -667,20 +784,9 @@ bid64tostr(char *restrict buf, size_t bsz, _Decimal64 x)
 	/* get the exponent, sign and mantissa */
 	e = quantexpbid64(x);
 	m = mant_bid64(x);
-	s = m ? sign_bid64(x) : 0/*no stinking signed naughts*/;
+	s = m ? -sign_bid64(x) : 0/*no stinking signed naughts*/;
 
-	/* reencode m as bcd */
-	with (uint_least64_t bcdm = 0U) {
-		for (size_t i = 0; i < 16U; i++) {
-			uint_least64_t digit;
-
-			bcdm >>= 4U;
-			digit = m % 10U, m /= 10U;
-			bcdm ^= digit << 60U;
-		}
-		m = bcdm;
-	}
-	return (int)bcd64tostr(buf, bsz, (bcd64_t){m, e, s});
+	return (int)bin64tostr(buf, bsz, m, e, s);
 }
 #elif defined HAVE_DFP754_DPD_LITERALS
 static int
@@ -696,27 +802,13 @@ dpd64tostr(char *restrict buf, size_t bsz, _Decimal64 x)
 	/* get the exponent, sign and mantissa */
 	e = quantexpdpd64(x);
 	if (LIKELY((m = mant_dpd64(x)))) {
-		uint_least64_t b;
-
-		s = sign_dpd64(x);
-		/* get us a proper bcd version of M */
-		b = (m >> 50U);
-		b <<= 12U;
-		b ^= unpack_declet((m >> 40U) & 0x3ffU);
-		b <<= 12U;
-		b ^= unpack_declet((m >> 30U) & 0x3ffU);
-		b <<= 12U;
-		b ^= unpack_declet((m >> 20U) & 0x3ffU);
-		b <<= 12U;
-		b ^= unpack_declet((m >> 10U) & 0x3ffU);
-		b <<= 12U;
-		b ^= unpack_declet((m >> 0U) & 0x3ffU);
-		m = b;
+		s = -sign_dpd64(x);
+		m = bin_dpd64(m);
 	} else {
-		/* no stinking signed 0s and m is in bcd form already */
+		/* no stinking signed 0s */
 		s = 0;
 	}
-	return bcd64tostr(buf, bsz, (bcd64_t){m, e, s});
+	return (int)bin64tostr(buf, bsz, m, e, s);
 }
 #endif	/* HAVE_DFP754_BID_LITERALS || HAVE_DFP754_DPD_LITERALS */
 
@@ -729,8 +821,7 @@ d64tostr(char *restrict buf, size_t bsz, _Decimal64 x)
 		return z;
 	} else if (UNLIKELY(isinfd64(x))) {
 		const size_t z = min_z(3U + (x < 0.df), bsz);
-		buf[0U] = '-';
-		memcpy(buf + (x < 0.df), "inf", z);
+		memcpy(buf, "-inf" + !(x < 0.df), z);
 		return z;
 	}
 #if defined HAVE_DFP754_BID_LITERALS
@@ -740,6 +831,62 @@ d64tostr(char *restrict buf, size_t bsz, _Decimal64 x)
 #endif	 /* HAVE_DFP754_*_LITERALS */
 }
 
+size_t
+d64tostrs(char *restrict buf, size_t bsz, size_t *restrict off,
+	    const _Decimal64 *src, size_t n, char sep)
+{
+	size_t len = 0U;
+	size_t i;
+
+	for (i = 0U; i < n; i += NBATCH) {
+		const size_t k = min_z(NBATCH, n - i);
+		uint_least64_t m[NBATCH];
+		int e[NBATCH];
+		int s[NBATCH];
+		unsigned int x[NBATCH];
+
+		/* decompose the whole batch first, this is pure bit
+		 * fiddling and doesn't depend on the output */
+		for (size_t j = 0U; j < k; j++) {
+			const _Decimal64 v = src[i + j];
+
+			/* nans and infs have combination field 1111x */
+			x[j] = (bits64(v) & 0x7800000000000000ULL) == 0x7800000000000000ULL;
+#if defined HAVE_DFP754_BID_LITERALS
+			e[j] = quantexpbid64(v);
+			m[j] = mant_bid64(v);
+			s[j] = m[j] ? -sign_bid64(v) : 0;
+#elif defined HAVE_DFP754_DPD_LITERALS
+			e[j] = quantexpdpd64(v);
+			m[j] = bin_dpd64(mant_dpd64(v));
+			s[j] = m[j] ? -sign_dpd64(v) : 0;
+#endif	/* HAVE_DFP754_*_LITERALS */
+		}
+		/* now write them */
+		for (size_t j = 0U; j < k; j++) {
+			size_t z;
+
+			off[i + j] = len;
+			if (UNLIKELY(x[j])) {
+				z = d64tostr(buf + len, bsz - len, src[i + j]);
+			} else {
+				z = bin64tostr(buf + len, bsz - len, m[j], e[j], s[j]);
+			}
+			if (UNLIKELY(!z || len + z >= bsz)) {
+				/* no room for the value and its separator */
+				i += j;
+				goto out;
+			}
+			len += z;
+			buf[len++] = sep;
+		}
+	}
+	i = n;
+out:
+	off[i] = len;
+	return i;
+}
+
 /* always use our own version,
  * the official version would return NAN in case the significand's
  * capacity is exceeded, we do fuckall in that case. */
@@ -778,4 +925,21 @@ decompd64(_Decimal64 x)
 #endif	/* HAVE_DFP754_*_LITERALS */
 }
 
+int_least64_t
+coefd64(int *e, _Decimal64 x)
+{
+	int_least64_t r;
+
+#if defined HAVE_DFP754_BID_LITERALS
+	*e = quantexpbid64(x);
+	r = mant_bid64(x);
+	r = sign_bid64(x) ? -r : r;
+#elif defined HAVE_DFP754_DPD_LITERALS
+	*e = quantexpdpd64(x);
+	r = bin_dpd64(mant_dpd64(x));
+	r = sign_dpd64(x) ? -r : r;
+#endif	/* HAVE_DFP754_*_LITERALS */
+	return r;
+}
+
 /* dfp754_d64.c ends here */
@@ -0,0 +1,364 @@
+/*** osort.c -- external sort of order lines by time
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of sex.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include "osort.h"
+#include "xquo.h"
+#include "nifty.h"
+
+/* a line in the memory run */
+struct ent_s {
+	tv_t t;
+	size_t off;
+	size_t len;
+};
+
+/* a sorted run, on file or, if FP is NULL, in memory */
+struct run_s {
+	FILE *fp;
+	/* current line, its length and time stamp */
+	const char *cur;
+	size_t n;
+	tv_t t;
+	/* getline() buffer, or the next entry of the memory run */
+	char *line;
+	size_t llen;
+	size_t i;
+};
+
+struct osort_s {
+	/* memory run, lines back to back and their index */
+	char *buf;
+	size_t bn;
+	size_t bz;
+	struct ent_s *e;
+	size_t ne;
+	size_t ze;
+	size_t mem;
+	/* runs, and the merge heap of run indices */
+	struct run_s *r;
+	size_t nr;
+	size_t zr;
+	size_t *h;
+	size_t nh;
+};
+
+
+static int
+ent_cmp(const void *x, const void *y)
+{
+/* by time, then by position in the input */
+	const struct ent_s *ex = x, *ey = y;
+
+	if (ex->t != ey->t) {
+		return ex->t < ey->t ? -1 : 1;
+	}
+	return (ex->off > ey->off) - (ex->off < ey->off);
+}
+
+static FILE*
+tmpf(void)
+{
+/* an anonymous temporary file in $TMPDIR */
+	const char *dir = getenv("TMPDIR") ?: "/tmp";
+	const size_t z = strlen(dir) + sizeof("/sex-XXXXXX");
+	char *fn;
+	FILE *fp;
+	int fd;
+
+	if (UNLIKELY((fn = malloc(z)) == NULL)) {
+		return NULL;
+	}
+	snprintf(fn, z, "%s/sex-XXXXXX", dir);
+	if (UNLIKELY((fd = mkstemp(fn)) < 0)) {
+		free(fn);
+		return NULL;
+	}
+	unlink(fn);
+	free(fn);
+	if (UNLIKELY((fp = fdopen(fd, "w+")) == NULL)) {
+		close(fd);
+	}
+	return fp;
+}
+
+static struct run_s*
+add_run(osort_t s)
+{
+	if (UNLIKELY(s->nr >= s->zr)) {
+		const size_t nuz = s->zr * 2U ?: 16U;
+		struct run_s *nur = realloc(s->r, nuz * sizeof(*s->r));
+
+		if (UNLIKELY(nur == NULL)) {
+			return NULL;
+		}
+		s->r = nur;
+		s->zr = nuz;
+	}
+	return memset(s->r + s->nr++, 0, sizeof(*s->r));
+}
+
+static bool
+next(struct run_s *r)
+{
+/* advance run R to its next line, return false if it's exhausted */
+	if (r->fp == NULL) {
+		return false;
+	}
+	with (ssize_t nrd = getline(&r->line, &r->llen, r->fp)) {
+		if (nrd <= 0) {
+			return false;
+		}
+		r->cur = r->line;
+		r->n = nrd;
+	}
+	r->t = strtotv(r->cur, NULL);
+	return true;
+}
+
+static bool
+next_mem(osort_t s, struct run_s *r)
+{
+	if (r->i >= s->ne) {
+		return false;
+	}
+	r->cur = s->buf + s->e[r->i].off;
+	r->n = s->e[r->i].len;
+	r->t = s->e[r->i].t;
+	r->i++;
+	return true;
+}
+
+static int
+spill(osort_t s)
+{
+/* sort the memory run and write it to a file of its own */
+	struct run_s *r;
+	FILE *fp;
+
+	if (UNLIKELY((fp = tmpf()) == NULL)) {
+		return -1;
+	} else if (UNLIKELY((r = add_run(s)) == NULL)) {
+		fclose(fp);
+		return -1;
+	}
+	r->fp = fp;
+	qsort(s->e, s->ne, sizeof(*s->e), ent_cmp);
+	for (size_t i = 0U; i < s->ne; i++) {
+		fwrite(s->buf + s->e[i].off, 1, s->e[i].len, fp);
+	}
+	if (UNLIKELY(fflush(fp) || ferror(fp) || fseek(fp, 0L, SEEK_SET))) {
+		return -1;
+	}
+	s->bn = 0U;
+	s->ne = 0U;
+	return 0;
+}
+
+static int
+add(osort_t s, const char *ln, size_t n)
+{
+/* append line LN of length N to the memory run, spilling first if
+ * that would exceed the budget, lines always end in a newline */
+	const size_t z = n + (ln[n - 1U] != '\n');
+
+	if (s->bn + z + (s->ne + 1U) * sizeof(*s->e) > s->mem && s->ne &&
+	    UNLIKELY(spill(s) < 0)) {
+		return -1;
+	}
+	if (UNLIKELY(s->bn + z > s->bz)) {
+		size_t nuz = s->bz * 2U ?: 65536U;
+		char *nub;
+
+		for (; nuz < s->bn + z; nuz *= 2U);
+		if (UNLIKELY((nub = realloc(s->buf, nuz)) == NULL)) {
+			return -1;
+		}
+		s->buf = nub;
+		s->bz = nuz;
+	}
+	if (UNLIKELY(s->ne >= s->ze)) {
+		const size_t nuz = s->ze * 2U ?: 4096U;
+		struct ent_s *nue = realloc(s->e, nuz * sizeof(*s->e));
+
+		if (UNLIKELY(nue == NULL)) {
+			return -1;
+		}
+		s->e = nue;
+		s->ze = nuz;
+	}
+	memcpy(s->buf + s->bn, ln, n);
+	s->buf[s->bn + z - 1U] = '\n';
+	s->e[s->ne++] = (struct ent_s){strtotv(ln, NULL), s->bn, z};
+	s->bn += z;
+	return 0;
+}
+
+static inline bool
+run_lt(const osort_t s, size_t i, size_t j)
+{
+/* runs hold consecutive stretches of the input, so the run index
+ * settles ties in input order */
+	return s->r[i].t < s->r[j].t || s->r[i].t == s->r[j].t && i < j;
+}
+
+static void
+sift(osort_t s, size_t i)
+{
+	const size_t x = s->h[i];
+
+	for (size_t c; (c = 2U * i + 1U) < s->nh; i = c) {
+		if (c + 1U < s->nh && run_lt(s, s->h[c + 1U], s->h[c])) {
+			c++;
+		}
+		if (!run_lt(s, s->h[c], x)) {
+			break;
+		}
+		s->h[i] = s->h[c];
+	}
+	s->h[i] = x;
+	return;
+}
+
+
+osort_t
+make_osort(FILE *fp, size_t mem)
+{
+	osort_t s;
+	char *line = NULL;
+	size_t llen = 0U;
+
+	if (UNLIKELY((s = calloc(1U, sizeof(*s))) == NULL)) {
+		return NULL;
+	}
+	s->mem = mem;
+	for (ssize_t nrd; (nrd = getline(&line, &llen, fp)) > 0;) {
+		if (UNLIKELY(add(s, line, nrd) < 0)) {
+			goto err;
+		}
+	}
+	free(line);
+	line = NULL;
+	if (UNLIKELY(ferror(fp))) {
+		goto err;
+	}
+	/* the last run stays in memory */
+	if (s->ne) {
+		struct run_s *r;
+
+		if (UNLIKELY((r = add_run(s)) == NULL)) {
+			goto err;
+		}
+		qsort(s->e, s->ne, sizeof(*s->e), ent_cmp);
+	}
+	if (UNLIKELY((s->h = malloc((s->nr + 1U) * sizeof(*s->h))) == NULL)) {
+		goto err;
+	}
+	for (size_t i = 0U; i < s->nr; i++) {
+		if (s->r[i].fp ? next(s->r + i) : next_mem(s, s->r + i)) {
+			s->h[s->nh++] = i;
+		}
+	}
+	for (size_t i = s->nh / 2U; i-- > 0U; sift(s, i));
+	return s;
+
+err:
+	with (int e = errno) {
+		free(line);
+		free_osort(s);
+		errno = e;
+	}
+	return NULL;
+}
+
+void
+free_osort(osort_t s)
+{
+	for (size_t i = 0U; i < s->nr; i++) {
+		if (s->r[i].fp != NULL) {
+			fclose(s->r[i].fp);
+		}
+		free(s->r[i].line);
+	}
+	free(s->r);
+	free(s->h);
+	free(s->e);
+	free(s->buf);
+	free(s);
+	return;
+}
+
+ssize_t
+osort_getline(char **line, size_t *llen, osort_t s)
+{
+	struct run_s *r;
+	size_t n;
+
+	if (UNLIKELY(!s->nh)) {
+		return -1;
+	}
+	r = s->r + s->h[0U];
+	if (UNLIKELY((n = r->n) >= *llen)) {
+		const size_t nuz = n + 1U > 2U * *llen ? n + 1U : 2U * *llen;
+		char *nul = realloc(*line, nuz);
+
+		if (UNLIKELY(nul == NULL)) {
+			return -1;
+		}
+		*line = nul;
+		*llen = nuz;
+	}
+	memcpy(*line, r->cur, n);
+	(*line)[n] = '\0';
+	/* move on in this run, or retire it */
+	if (!(r->fp ? next(r) : next_mem(s, r))) {
+		s->h[0U] = s->h[--s->nh];
+	}
+	if (s->nh) {
+		sift(s, 0U);
+	}
+	return n;
+}
+
+/* osort.c ends here */
@@ -0,0 +1,61 @@
+/*** osort.h -- external sort of order lines by time
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of sex.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if !defined INCLUDED_osort_h_
+#define INCLUDED_osort_h_
+#include <stdio.h>
+#include <unistd.h>
+
+typedef struct osort_s *osort_t;
+
+/**
+ * Read all lines from FP and sort them by their leading time stamp,
+ * lines with the same time stamp stay in input order.
+ * At most MEM bytes are held in memory, the excess is spilled as
+ * sorted runs to temporary files in $TMPDIR, or /tmp if unset.
+ * Return NULL and leave errno set on failure. */
+extern osort_t make_osort(FILE *fp, size_t mem);
+
+/**
+ * Free sorter S and its temporary files. */
+extern void free_osort(osort_t s);
+
+/**
+ * Like getline() but return the next line from sorter S, merging the
+ * runs as it goes. */
+extern ssize_t osort_getline(char **line, size_t *llen, osort_t s);
+
+#endif	/* INCLUDED_osort_h_ */
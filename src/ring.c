@@ -0,0 +1,254 @@
+/*** ring.c -- single-producer single-consumer ring
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of sex.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include "ring.h"
+#include "nifty.h"
+
+/* number of polls before a side goes to sleep */
+#define NSPIN	(256U)
+
+struct ring_s {
+	/* consumer's cache line */
+	_Alignas(64) atomic_size_t head;
+	size_t tcch;
+	atomic_bool cwait;
+	/* producer's cache line */
+	_Alignas(64) atomic_size_t tail;
+	size_t hcch;
+	atomic_bool pwait;
+	atomic_bool clsd;
+	/* shared and read-only */
+	_Alignas(64) pthread_mutex_t mtx;
+	pthread_cond_t cc;
+	pthread_cond_t pc;
+	size_t mask;
+	size_t slotz;
+	_Alignas(64) char slots[];
+};
+
+
+static inline void
+wake(ring_t r, atomic_bool *w, pthread_cond_t *c)
+{
+	if (UNLIKELY(atomic_load(w))) {
+		pthread_mutex_lock(&r->mtx);
+		pthread_cond_signal(c);
+		pthread_mutex_unlock(&r->mtx);
+	}
+	return;
+}
+
+static bool
+pfull(ring_t r)
+{
+	const size_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+	if (t - r->hcch <= r->mask) {
+		return false;
+	}
+	r->hcch = atomic_load(&r->head);
+	return t - r->hcch > r->mask;
+}
+
+static bool
+cempty(ring_t r)
+{
+	const size_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+	if (h != r->tcch) {
+		return false;
+	}
+	r->tcch = atomic_load(&r->tail);
+	return h == r->tcch;
+}
+
+
+ring_t
+make_ring(size_t nslot, size_t slotz)
+{
+	ring_t r;
+
+	/* round slot size up to a multiple of the alignment */
+	slotz = (slotz + 15U) & ~(size_t)15U;
+	if (UNLIKELY(nslot & (nslot - 1U))) {
+		return NULL;
+	} else if (UNLIKELY((r = aligned_alloc(64U, sizeof(*r) + nslot * slotz)) == NULL)) {
+		return NULL;
+	}
+	atomic_init(&r->head, 0U);
+	atomic_init(&r->tail, 0U);
+	atomic_init(&r->cwait, false);
+	atomic_init(&r->pwait, false);
+	atomic_init(&r->clsd, false);
+	r->tcch = 0U;
+	r->hcch = 0U;
+	pthread_mutex_init(&r->mtx, NULL);
+	pthread_cond_init(&r->cc, NULL);
+	pthread_cond_init(&r->pc, NULL);
+	r->mask = nslot - 1U;
+	r->slotz = slotz;
+	return r;
+}
+
+void
+free_ring(ring_t r)
+{
+	pthread_cond_destroy(&r->pc);
+	pthread_cond_destroy(&r->cc);
+	pthread_mutex_destroy(&r->mtx);
+	free(r);
+	return;
+}
+
+void*
+ring_prod(ring_t r)
+{
+	const size_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+	for (size_t i = 0U; pfull(r); i++) {
+		if (i < NSPIN) {
+			sched_yield();
+			continue;
+		}
+		/* announce ourselves then check again before sleeping */
+		pthread_mutex_lock(&r->mtx);
+		atomic_store(&r->pwait, true);
+		if (pfull(r)) {
+			pthread_cond_wait(&r->pc, &r->mtx);
+		}
+		atomic_store(&r->pwait, false);
+		pthread_mutex_unlock(&r->mtx);
+	}
+	return r->slots + (t & r->mask) * r->slotz;
+}
+
+void
+ring_push(ring_t r)
+{
+	const size_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+	atomic_store(&r->tail, t + 1U);
+	wake(r, &r->cwait, &r->cc);
+	return;
+}
+
+void
+ring_close(ring_t r)
+{
+	atomic_store(&r->clsd, true);
+	pthread_mutex_lock(&r->mtx);
+	pthread_cond_signal(&r->cc);
+	pthread_mutex_unlock(&r->mtx);
+	return;
+}
+
+void*
+ring_cons(ring_t r)
+{
+	const size_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+	for (size_t i = 0U; cempty(r); i++) {
+		if (atomic_load(&r->clsd)) {
+			/* check once more, the producer might have
+			 * pushed before closing */
+			if (cempty(r)) {
+				return NULL;
+			}
+			break;
+		} else if (i < NSPIN) {
+			sched_yield();
+			continue;
+		}
+		pthread_mutex_lock(&r->mtx);
+		atomic_store(&r->cwait, true);
+		if (cempty(r) && !atomic_load(&r->clsd)) {
+			pthread_cond_wait(&r->cc, &r->mtx);
+		}
+		atomic_store(&r->cwait, false);
+		pthread_mutex_unlock(&r->mtx);
+	}
+	return r->slots + (h & r->mask) * r->slotz;
+}
+
+bool
+ring_wait(ring_t r, unsigned long long int nsec)
+{
+	struct timespec ts;
+	int rc = 0;
+
+	for (size_t i = 0U; i < NSPIN; i++) {
+		if (!cempty(r) || atomic_load(&r->clsd)) {
+			return true;
+		}
+		sched_yield();
+	}
+	/* condition variables time out on the wall clock */
+	clock_gettime(CLOCK_REALTIME, &ts);
+	nsec += ts.tv_nsec;
+	ts.tv_sec += nsec / 1000000000ULL;
+	ts.tv_nsec = nsec % 1000000000ULL;
+
+	pthread_mutex_lock(&r->mtx);
+	atomic_store(&r->cwait, true);
+	while (cempty(r) && !atomic_load(&r->clsd) && rc != ETIMEDOUT) {
+		rc = pthread_cond_timedwait(&r->cc, &r->mtx, &ts);
+	}
+	atomic_store(&r->cwait, false);
+	pthread_mutex_unlock(&r->mtx);
+	return !cempty(r) || atomic_load(&r->clsd);
+}
+
+void
+ring_pop(ring_t r)
+{
+	const size_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+	atomic_store(&r->head, h + 1U);
+	wake(r, &r->pwait, &r->pc);
+	return;
+}
+
+/* ring.c ends here */
@@ -0,0 +1,84 @@
+/*** ring.h -- single-producer single-consumer ring
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of sex.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if !defined INCLUDED_ring_h_
+#define INCLUDED_ring_h_
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * A bounded queue of fixed-size slots between exactly one producer
+ * and one consumer thread.  Slots are filled and read in place, the
+ * producer blocks while the ring is full, the consumer while it is
+ * empty. */
+typedef struct ring_s *ring_t;
+
+/**
+ * Return a new ring of NSLOT slots of SLOTZ bytes each.
+ * NSLOT must be a power of 2. */
+extern ring_t make_ring(size_t nslot, size_t slotz);
+
+/**
+ * Free ring R, neither side must be using it anymore. */
+extern void free_ring(ring_t r);
+
+/**
+ * Producer side: return the next free slot, blocking while R is full. */
+extern void *ring_prod(ring_t r);
+
+/**
+ * Producer side: publish the slot obtained by ring_prod(). */
+extern void ring_push(ring_t r);
+
+/**
+ * Producer side: announce that no more slots will be pushed. */
+extern void ring_close(ring_t r);
+
+/**
+ * Consumer side: return the oldest published slot, blocking while R is
+ * empty, or NULL if R is empty and has been closed. */
+extern void *ring_cons(ring_t r);
+
+/**
+ * Consumer side: wait at most NSEC nanoseconds for R to have a slot or
+ * to be closed, return whether ring_cons() would return right away. */
+extern bool ring_wait(ring_t r, unsigned long long int nsec);
+
+/**
+ * Consumer side: release the slot obtained by ring_cons(). */
+extern void ring_pop(ring_t r);
+
+#endif	/* INCLUDED_ring_h_ */
@@ -42,7 +42,14 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <limits.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
 #if defined HAVE_DFP754_H
 # include <dfp754.h>
 #elif defined HAVE_DFP_STDLIB_H
@@ -60,23 +67,56 @@ fabsd64(_Decimal64 x)
 {
 	return x >= 0 ? x : -x;
 }
+# if defined BOOKSD32
+static inline __attribute__((pure, const)) _Decimal32
+fabsd32(_Decimal32 x)
+{
+	return x >= 0 ? x : -x;
+}
+# endif	/* BOOKSD32 */
 #endif	/* DFP754_H || HAVE_DFP_STDLIB_H || HAVE_DECIMAL_H */
 #include <books/books.h>
+#if defined BOOKSD32
+# include "dfp754_d32.h"
+#endif	/* BOOKSD32 */
 #include "dfp754_d64.h"
 #include "xquo.h"
 #include "hash.h"
+#include "sink.h"
+#include "ring.h"
+#include "osort.h"
 #include "nifty.h"
 
+#if defined BOOKSD32
+# define strtopx	strtod32
+# define pxtostr	d32tostr
+# define NANPX		NAND32
+# define isnanpx	isnand32
+# define fabspx		fabsd32
+#else  /* !BOOKSD32 */
+# define strtopx	strtod64
+# define pxtostr	d64tostr
+# define NANPX		NAND64
+# define isnanpx	isnand64
+# define fabspx		fabsd64
+#endif	/* BOOKSD32 */
 #define strtoqx		strtod64
-#define strtopx		strtod64
 #define qxtostr		d64tostr
-#define pxtostr		d64tostr
+#define NANQX		NAND64
+#define isnanqx		isnand64
+#define fabsqx		fabsd64
 
-#define NANPX		NAND64
-#define isnanpx		isnand64
+/* wide accumulator, i.e. M * 10^E exactly,
+ * exponents never go below WXMINE, products are rounded to that */
+typedef struct {
+	__int128 m;
+	int e;
+} wx_t;
 
-#define fabspx		fabsd64
-#define fabsqx		fabsd64
+#define WXMINE	(-18)
+
+#define NOT_A_WX	((wx_t){0, INT_MIN})
+#define NOT_A_WX_P(x)	((x).e == INT_MIN)
 
 typedef struct {
 	qx_t q;
@@ -94,13 +134,16 @@ typedef struct {
 	tv_t y;
 	/* oldest liquidity touched */
 	tv_t z;
+	/* tag of the order executed */
+	const char *tag;
+	size_t tgz;
 } exe_t;
 
 typedef struct {
-	qx_t base;
-	qx_t term;
-	qx_t comm;
-	qx_t effs;
+	wx_t base;
+	wx_t term;
+	wx_t comm;
+	wx_t effs;
 	tv_t yngt;
 	tv_t oldt;
 } acc_t;
@@ -110,13 +153,108 @@ typedef struct {
 	px_t term;
 } com_t;
 
+/* run statistics, all marked to mid */
+typedef struct {
+	/* number of fills and round trips, and profitable trips */
+	size_t nfil;
+	size_t ntrp;
+	size_t nwin;
+	/* sign of the position after the last fill */
+	int sgn;
+	/* last valid mid */
+	wx_t mid;
+	/* equity after the last fill, its peak, and at the last flat */
+	wx_t eqty;
+	wx_t peak;
+	wx_t flat;
+	/* maximum drawdown */
+	wx_t mxdd;
+	/* traded terms volume */
+	wx_t turn;
+	/* sum of effective spreads */
+	wx_t effs;
+	/* sum of liquidity ages */
+	tv_t yngt;
+	tv_t oldt;
+	/* time of the last fill */
+	tv_t t;
+} sum_t;
+
+/* output events, as passed to the writer thread */
+typedef struct {
+	enum {
+		EV_EXE,
+		EV_ACC,
+		EV_MTM,
+		/* unfilled remainders, x.p is the limit */
+		EV_REJ,
+		EV_EXP,
+	} typ;
+	/* metronome at the time */
+	tv_t m;
+	/* top of book, EV_MTM only */
+	px_t bid;
+	px_t ask;
+	union {
+		exe_t x;
+		acc_t a;
+	};
+} ev_t;
+
 static const char *cont;
 static size_t conz;
 static hx_t conx;
 
 static qx_t _glob_qty = 1.dd;
 static tv_t _glob_age;
+/* maximum time orders stay in the book, 0 for no limit */
+static tv_t _glob_maxage;
+/* mark-to-market interval, 0 for none */
+static tv_t _glob_mtm;
 static com_t _glob_com = {0.dd, 0.dd};
+static enum {
+	EMIT_EXE = 1U,
+	EMIT_ACC = 2U,
+	EMIT_FIN = 4U,
+	EMIT_EXP = 8U,
+} _glob_emit = EMIT_EXE | EMIT_ACC | EMIT_EXP;
+static bool _glob_summ;
+/* skip effective spreads */
+static bool _glob_noeffs;
+/* cap positions at two orders' worth, or read quantities as positions */
+static bool _glob_maxq;
+static bool _glob_absq;
+/* walk the book once for orders alike in time, side, type and limit,
+ * and share the fill in order of arrival or pro rata */
+static enum {
+	COAL_NONE,
+	COAL_FIFO,
+	COAL_PRORATA,
+} _glob_coal;
+static sum_t summ = {
+	.mid = NOT_A_WX,
+	.eqty = {0, 0}, .peak = {0, 0}, .flat = {0, 0}, .mxdd = {0, 0},
+	.turn = {0, 0}, .effs = {0, 0},
+};
+
+/* output buffer size, maximum record size and the sink itself */
+#define OBUF	(4U * 1024U * 1024U)
+#define OREC	(256U)
+static sink_t out;
+static size_t orec = OREC;
+/* fixed-width mode, numeric field width, 0 for variable width,
+ * the width of time stamps and the resulting record width */
+#define FIXTV	(20U)
+static size_t _glob_fixw;
+static size_t recw;
+/* set once a value didn't fit its fixed-width field */
+static bool fldovf;
+/* order sorter, if orders are to be sorted, and its default budget */
+#define OSORTMEM	(256U * 1024U * 1024U)
+static osort_t osrt;
+/* number of events in flight between matcher and writer */
+#define NEVQ	(4096U)
+static ring_t evq;
 
 
 static __attribute__((format(printf, 1, 2))) void
@@ -141,6 +279,152 @@ max_tv(tv_t t1, tv_t t2)
 	return t1 >= t2 ? t1 : t2;
 }
 
+static bool
+scal10(__int128 *m, unsigned int n)
+{
+/* multiply *M by 10^N, return false if that overflows */
+	static const int_least64_t p10[] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+		100000000, 1000000000, 10000000000, 100000000000,
+		1000000000000, 10000000000000, 100000000000000,
+		1000000000000000, 10000000000000000, 100000000000000000,
+		1000000000000000000,
+	};
+
+	for (; UNLIKELY(n >= countof(p10)); n -= countof(p10) - 1U) {
+		if (__builtin_mul_overflow(*m, p10[countof(p10) - 1U], m)) {
+			return false;
+		}
+	}
+	return !__builtin_mul_overflow(*m, p10[n], m);
+}
+
+static __attribute__((pure, const)) wx_t
+rnd_wx(wx_t x, int e)
+{
+/* round X half-even to exponent E, E being coarser than X's */
+	__int128 p = 1, q, r;
+
+	if (UNLIKELY(!scal10(&p, e - x.e))) {
+		/* more than 38 digits off, nothing is left */
+		return (wx_t){0, e};
+	}
+	q = x.m / p;
+	r = x.m % p;
+	r = r >= 0 ? r : -r;
+	if (r > p - r || r == p - r && q % 2) {
+		q += x.m >= 0 ? 1 : -1;
+	}
+	return (wx_t){q, e};
+}
+
+static inline __attribute__((pure, const)) wx_t
+qxtowx(qx_t x)
+{
+	int e;
+	int_least64_t m;
+
+	if (UNLIKELY(isnanqx(x))) {
+		return NOT_A_WX;
+	}
+	m = coefd64(&e, x);
+	if (UNLIKELY(e < WXMINE)) {
+		return rnd_wx((wx_t){m, e}, WXMINE);
+	}
+	return (wx_t){m, e};
+}
+
+#if defined BOOKSD32
+static inline __attribute__((pure, const)) wx_t
+pxtowx(px_t x)
+{
+	int e;
+	int_least32_t m;
+
+	if (UNLIKELY(isnanpx(x))) {
+		return NOT_A_WX;
+	}
+	m = coefd32(&e, x);
+	if (UNLIKELY(e < WXMINE)) {
+		return rnd_wx((wx_t){m, e}, WXMINE);
+	}
+	return (wx_t){m, e};
+}
+#else  /* !BOOKSD32 */
+# define pxtowx		qxtowx
+#endif	/* BOOKSD32 */
+
+static __attribute__((pure, const)) qx_t
+wxtoqx(wx_t x)
+{
+/* round X to the 16 digits of a qx_t */
+	static const __int128 lim = (__int128)10000000000000000;
+	int n = 0;
+
+	if (UNLIKELY(NOT_A_WX_P(x))) {
+		return NANQX;
+	}
+	for (__int128 u = x.m >= 0 ? x.m : -x.m; u >= lim; u /= 10, n++);
+	if (n) {
+		x = rnd_wx(x, x.e + n);
+	}
+	return scalbnd64((qx_t)(int_least64_t)x.m, x.e);
+}
+
+static inline __attribute__((pure, const)) wx_t
+add_wx(wx_t x, wx_t y)
+{
+/* like decimals, the sum takes the smaller exponent of X and Y,
+ * overflows give NOT_A_WX */
+	if (UNLIKELY(NOT_A_WX_P(x) || NOT_A_WX_P(y))) {
+		return NOT_A_WX;
+	} else if (x.e > y.e) {
+		if (UNLIKELY(!scal10(&x.m, x.e - y.e))) {
+			return NOT_A_WX;
+		}
+		x.e = y.e;
+	} else if (x.e < y.e) {
+		if (UNLIKELY(!scal10(&y.m, y.e - x.e))) {
+			return NOT_A_WX;
+		}
+	}
+	if (UNLIKELY(__builtin_add_overflow(x.m, y.m, &x.m))) {
+		return NOT_A_WX;
+	}
+	return x;
+}
+
+static inline __attribute__((pure, const)) wx_t
+mul_wx(wx_t x, wx_t y)
+{
+/* the product, rounded to WXMINE, overflows give NOT_A_WX */
+	wx_t r;
+
+	if (UNLIKELY(NOT_A_WX_P(x) || NOT_A_WX_P(y))) {
+		return NOT_A_WX;
+	}
+	/* not any earlier, NOT_A_WX's INT_MIN exponent would overflow */
+	r.e = x.e + y.e;
+	if (UNLIKELY(__builtin_mul_overflow(x.m, y.m, &r.m))) {
+		return NOT_A_WX;
+	} else if (r.e < WXMINE) {
+		return rnd_wx(r, WXMINE);
+	}
+	return r;
+}
+
+static inline __attribute__((pure, const)) wx_t
+neg_wx(wx_t x)
+{
+	return (wx_t){-x.m, x.e};
+}
+
+static inline __attribute__((pure, const)) wx_t
+fabswx(wx_t x)
+{
+	return (wx_t){x.m >= 0 ? x.m : -x.m, x.e};
+}
+
 static inline __attribute__((pure, const)) book_side_t
 contra(book_side_t s)
 {
@@ -153,9 +437,9 @@ pdo2tra(book_pdo_t pd, book_side_t s)
 {
 	switch (s) {
 	case BOOK_SIDE_ASK:
-		return (tra_t){pd.base, pd.term / pd.base};
+		return (tra_t){pd.base, (px_t)(pd.term / pd.base)};
 	case BOOK_SIDE_BID:
-		return (tra_t){-pd.base, pd.term / pd.base};
+		return (tra_t){-pd.base, (px_t)(pd.term / pd.base)};
 	default:
 		break;
 	}
@@ -167,8 +451,25 @@ ao(ord_t o, acc_t a)
 {
 	switch (o.sid) {
 	case BOOK_SIDE_CLR:
-		o.sid = a.base < 0.dd ? BOOK_SIDE_ASK : BOOK_SIDE_BID;
-		o.qty = o.qty ?: fabsqx(a.base);
+		o.sid = a.base.m < 0 ? BOOK_SIDE_ASK : BOOK_SIDE_BID;
+		o.qty = o.qty ?: wxtoqx(fabswx(a.base));
+		break;
+	case BOOK_SIDE_ASK:
+	case BOOK_SIDE_BID:
+		if (LIKELY(!_glob_maxq && !_glob_absq)) {
+			break;
+		}
+		/* position in the direction of O */
+		with (qx_t p = wxtoqx(a.base)) {
+			p = o.sid == BOOK_SIDE_ASK ? p : -p;
+			if (_glob_absq) {
+				/* trade up to the position asked for */
+				o.qty = max(o.qty - p, 0.dd);
+			} else {
+				/* trade no further than 2 orders' worth */
+				o.qty = min(o.qty, max(2 * _glob_qty - p, 0.dd));
+			}
+		}
 		break;
 	default:
 		break;
@@ -177,36 +478,139 @@ ao(ord_t o, acc_t a)
 }
 
 
+static size_t
+wxtostr(char *restrict buf, size_t bsz, wx_t x)
+{
+/* like qxtostr() but for wide accumulators */
+	char dig[48U];
+	unsigned __int128 u;
+	size_t nd = 0U;
+	size_t len = 0U;
+
+	if (UNLIKELY(NOT_A_WX_P(x))) {
+		return (memcpy(buf, "nan", 3U), 3U);
+	} else if (UNLIKELY(bsz < sizeof(dig) + (x.e >= 0 ? x.e : -x.e))) {
+		return 0U;
+	}
+	/* digits, least significant first */
+	u = x.m >= 0 ? x.m : -x.m;
+	do {
+		dig[nd++] = (char)((unsigned int)(u % 10U) ^ '0');
+	} while ((u /= 10U));
+
+	buf[len] = '-';
+	len += x.m < 0;
+	if (x.e >= 0) {
+		for (; nd > 0U; buf[len++] = dig[--nd]);
+		for (int e = x.e; e > 0; e--, buf[len++] = '0');
+	} else if (nd > (size_t)-x.e) {
+		for (; nd > (size_t)-x.e; buf[len++] = dig[--nd]);
+		buf[len++] = '.';
+		for (; nd > 0U; buf[len++] = dig[--nd]);
+	} else {
+		buf[len++] = '0';
+		buf[len++] = '.';
+		for (size_t i = -x.e; i > nd; i--, buf[len++] = '0');
+		for (; nd > 0U; buf[len++] = dig[--nd]);
+	}
+	return len;
+}
+
+static size_t
+fld(char *restrict buf, size_t beg, size_t n, size_t w)
+{
+/* field of N bytes at BEG, return its end, in fixed-width mode the
+ * field is right-aligned in W columns or, if it doesn't fit, filled
+ * with `#' and complained about, once */
+	if (LIKELY(!_glob_fixw)) {
+		return beg + n;
+	} else if (UNLIKELY(!n || n > w)) {
+		memset(buf + beg, '#', w);
+		if (!fldovf) {
+			fldovf = true;
+			errno = 0, serror("\
+Error: value too wide for --fixed=%zu, replaced by `#'", _glob_fixw);
+		}
+	} else if (n < w) {
+		memmove(buf + beg + w - n, buf + beg, n);
+		memset(buf + beg, ' ', w - n);
+	}
+	return beg + w;
+}
+
+static size_t
+eol(char *restrict buf, size_t len)
+{
+/* terminate record, in fixed-width mode pad it to the record width */
+	if (UNLIKELY(len < recw)) {
+		memset(buf + len, ' ', recw - len);
+		len = recw;
+	}
+	buf[len++] = '\n';
+	return len;
+}
+
+static size_t
+fixrecw(void)
+{
+/* width of the widest record we're going to emit */
+	const size_t w = _glob_fixw;
+	const size_t pre = FIXTV + 1U + conz + 1U + 4U;
+	size_t r = 0U;
+
+	if (_glob_emit) {
+		/* EXE, REJ, EXP and ACC have the same layout, plus a tag
+		 * column of W for which lines are padded */
+		r = pre + 4U * (w + 1U) + FIXTV + 1U + FIXTV + 1U + w;
+	}
+	if (_glob_mtm) {
+		const size_t z = pre + 2U * (w + 1U) + w;
+		r = z > r ? z : r;
+	}
+	if (_glob_summ) {
+		const size_t z = pre + 7U * (w + 1U) + FIXTV + 1U + FIXTV;
+		r = z > r ? z : r;
+	}
+	return r;
+}
+
 static void
-send_exe(tv_t m, exe_t x)
+send_exe(tv_t m, exe_t x, const char verb[static 4U])
 {
-	static const char vexe[] = "EXE\t";
-	static const char vrej[] = "REJ\t";
-	char buf[256U];
+	static tvpfx_t cm, cy, cz;
+	char *buf = sink_get(out, orec + x.tgz);
 	size_t len = 0U;
 
-	len += tvtostr(buf + len, sizeof(buf) - len, m);
+	len = fld(buf, len, tvtostr_r(buf + len, orec - len, m, &cm), FIXTV);
 	buf[len++] = '\t';
 	len += (memcpy(buf + len, cont, conz), conz);
 	buf[len++] = '\t';
-	len += (memcpy(buf + len, isnanpx(x.p) ? vrej : vexe, 4U), 4U);
-	len += qxtostr(buf + len, sizeof(buf) - len, x.q);
+	len += (memcpy(buf + len, verb, 4U), 4U);
+	len = fld(buf, len, qxtostr(buf + len, orec - len, x.q), _glob_fixw);
 	buf[len++] = '\t';
-	len += pxtostr(buf + len, sizeof(buf) - len, x.p);
+	len = fld(buf, len, pxtostr(buf + len, orec - len, x.p), _glob_fixw);
 	/* top spread at the time */
 	buf[len++] = '\t';
-	len += pxtostr(buf + len, sizeof(buf) - len, x.s);
+	len = fld(buf, len, pxtostr(buf + len, orec - len, x.s), _glob_fixw);
 	/* eff spread at the time */
 	buf[len++] = '\t';
-	len += pxtostr(buf + len, sizeof(buf) - len, x.e);
+	len = fld(buf, len, pxtostr(buf + len, orec - len, x.e), _glob_fixw);
 	/* youngest touched */
 	buf[len++] = '\t';
-	len += tvtostr(buf + len, sizeof(buf) - len, x.y);
+	len = fld(buf, len, tvtostr_r(buf + len, orec - len, x.y, &cy), FIXTV);
 	/* oldest touched */
 	buf[len++] = '\t';
-	len += tvtostr(buf + len, sizeof(buf) - len, x.z);
-	buf[len++] = '\n';
-	fwrite(buf, 1, len, stdout);
+	len = fld(buf, len, tvtostr_r(buf + len, orec - len, x.z, &cz), FIXTV);
+	/* order tag, free text, neither aligned nor checked for width,
+	 * in fixed-width mode longer tags simply run past the record */
+	if (x.tgz) {
+		buf[len++] = '\t';
+		len += (memcpy(buf + len, x.tag, x.tgz), x.tgz);
+	} else if (_glob_fixw) {
+		buf[len++] = '\t';
+	}
+	len = eol(buf, len);
+	sink_put(out, len);
 	return;
 }
 
@@ -214,27 +618,309 @@ static void
 send_acc(tv_t m, acc_t a)
 {
 	static const char verb[] = "ACC\t";
-	char buf[256U];
+	static tvpfx_t cm, cy, co;
+	char *buf = sink_get(out, orec);
 	size_t len;
 
-	len = tvtostr(buf, sizeof(buf), m);
+	len = fld(buf, 0U, tvtostr_r(buf, orec, m, &cm), FIXTV);
 	buf[len++] = '\t';
 	len += (memcpy(buf + len, cont, conz), conz);
 	buf[len++] = '\t';
 	len += (memcpy(buf + len, verb, strlenof(verb)), strlenof(verb));
-	len += qxtostr(buf + len, sizeof(buf) - len, a.base);
+	len = fld(buf, len,
+		  wxtostr(buf + len, orec - len, a.base), _glob_fixw);
 	buf[len++] = '\t';
-	len += qxtostr(buf + len, sizeof(buf) - len, a.term);
+	len = fld(buf, len,
+		  wxtostr(buf + len, orec - len, a.term), _glob_fixw);
 	buf[len++] = '\t';
-	len += qxtostr(buf + len, sizeof(buf) - len, a.comm);
+	len = fld(buf, len,
+		  wxtostr(buf + len, orec - len, a.comm), _glob_fixw);
 	buf[len++] = '\t';
-	len += qxtostr(buf + len, sizeof(buf) - len, a.effs);
+	len = fld(buf, len,
+		  wxtostr(buf + len, orec - len, a.effs), _glob_fixw);
 	buf[len++] = '\t';
-	len += tvtostr(buf + len, sizeof(buf) - len, a.yngt);
+	len = fld(buf, len,
+		  tvtostr_r(buf + len, orec - len, a.yngt, &cy), FIXTV);
 	buf[len++] = '\t';
-	len += tvtostr(buf + len, sizeof(buf) - len, a.oldt);
-	buf[len++] = '\n';
-	fwrite(buf, 1, len, stdout);
+	len = fld(buf, len,
+		  tvtostr_r(buf + len, orec - len, a.oldt, &co), FIXTV);
+	len = eol(buf, len);
+	sink_put(out, len);
+	return;
+}
+
+static void
+send_mtm(tv_t m, acc_t a, px_t bid, px_t ask)
+{
+	static const char verb[] = "MTM\t";
+	static const wx_t half = {5, -1};
+	static tvpfx_t cm;
+	char *buf = sink_get(out, orec);
+	const wx_t mid = mul_wx(add_wx(pxtowx(bid), pxtowx(ask)), half);
+	const wx_t pos = a.base.m ? mul_wx(a.base, mid) : a.base;
+	size_t len;
+
+	len = fld(buf, 0U, tvtostr_r(buf, orec, m, &cm), FIXTV);
+	buf[len++] = '\t';
+	len += (memcpy(buf + len, cont, conz), conz);
+	buf[len++] = '\t';
+	len += (memcpy(buf + len, verb, strlenof(verb)), strlenof(verb));
+	/* position, the mid it's valued at and total equity */
+	len = fld(buf, len,
+		  wxtostr(buf + len, orec - len, a.base), _glob_fixw);
+	buf[len++] = '\t';
+	len = fld(buf, len, wxtostr(buf + len, orec - len, mid), _glob_fixw);
+	buf[len++] = '\t';
+	len = fld(buf, len,
+		  wxtostr(buf + len, orec - len, add_wx(add_wx(a.term, a.comm), pos)), _glob_fixw);
+	len = eol(buf, len);
+	sink_put(out, len);
+	return;
+}
+
+/* order tags are stashed in chunks of ZSTASH bytes, aligned to their
+ * size so that a tag leads back to its chunk, every order and every
+ * output event referring to a tag holds a reference to the chunk, and
+ * chunks nobody refers to any more are filled anew */
+#define ZSTASH	(4096U)
+#define MAXTAG	(OREC)
+/* spent chunks looked for before a new one is allocated */
+#define NSTSCAN	(8U)
+struct stash_s {
+	struct stash_s *next;
+	/* references, the chunk being filled holds one itself,
+	 * the writer thread lets go of those held by events */
+	atomic_size_t ref;
+	size_t n;
+	char b[];
+};
+/* the chunk being filled, all chunks, and where to look for spent ones */
+static struct stash_s *stsh, *stal, *stcur;
+
+static inline struct stash_s*
+stash_of(const char *tag)
+{
+	return (struct stash_s*)((uintptr_t)tag & ~(uintptr_t)(ZSTASH - 1U));
+}
+
+static inline void
+restash(const char *tag, size_t tgz)
+{
+/* take another reference to TAG */
+	if (tgz) {
+		atomic_fetch_add_explicit(&stash_of(tag)->ref, 1U,
+					  memory_order_relaxed);
+	}
+	return;
+}
+
+static inline void
+unstash(const char *tag, size_t tgz)
+{
+/* let go of a reference to TAG, its chunk may be refilled after this */
+	if (tgz) {
+		atomic_fetch_sub_explicit(&stash_of(tag)->ref, 1U,
+					  memory_order_release);
+	}
+	return;
+}
+
+static struct stash_s*
+stash_chunk(void)
+{
+/* find a chunk nobody refers to any more, or allocate one */
+	struct stash_s *c;
+
+	for (size_t i = 0U; i < NSTSCAN && stal != NULL; i++) {
+		c = stcur ?: stal;
+		stcur = c->next;
+		if (!atomic_load_explicit(&c->ref, memory_order_acquire)) {
+			return c;
+		}
+	}
+	if (UNLIKELY((c = aligned_alloc(ZSTASH, ZSTASH)) == NULL)) {
+		return NULL;
+	}
+	c->next = stal;
+	stal = c;
+	return c;
+}
+
+static const char*
+stash(const char *s, size_t z)
+{
+/* copy tag S of Z bytes, at most MAXTAG, off the line buffer
+ * and hold a reference to it on behalf of its order */
+	char *r;
+
+	if (UNLIKELY(stsh == NULL ||
+		     stsh->n + z > ZSTASH - offsetof(struct stash_s, b))) {
+		if (stsh != NULL) {
+			/* done filling this one */
+			atomic_fetch_sub_explicit(&stsh->ref, 1U,
+						  memory_order_release);
+		}
+		if (UNLIKELY((stsh = stash_chunk()) == NULL)) {
+			return NULL;
+		}
+		atomic_store_explicit(&stsh->ref, 1U, memory_order_relaxed);
+		stsh->n = 0U;
+	}
+	r = stsh->b + stsh->n;
+	memcpy(r, s, z);
+	stsh->n += z;
+	atomic_fetch_add_explicit(&stsh->ref, 1U, memory_order_relaxed);
+	return r;
+}
+
+static void
+free_stash(void)
+{
+	for (struct stash_s *p; (p = stal) != NULL; stal = p->next, free(p));
+	stsh = stcur = NULL;
+	return;
+}
+
+static void*
+writer(void *UNUSED(clo))
+{
+	static const char vexe[] = "EXE\t";
+	static const char vrej[] = "REJ\t";
+	static const char vexp[] = "EXP\t";
+
+	/* format and write events in the order they were pushed */
+	for (const ev_t *e;; ring_pop(evq)) {
+		while (!ring_wait(evq, SINK_IVAL)) {
+			/* nothing to write for a while */
+			sink_idle(out);
+		}
+		if ((e = ring_cons(evq)) == NULL) {
+			break;
+		}
+		switch (e->typ) {
+		case EV_EXE:
+			send_exe(e->m, e->x, isnanpx(e->x.p) ? vrej : vexe);
+			unstash(e->x.tag, e->x.tgz);
+			break;
+		case EV_REJ:
+			send_exe(e->m, e->x, vrej);
+			unstash(e->x.tag, e->x.tgz);
+			break;
+		case EV_EXP:
+			send_exe(e->m, e->x, vexp);
+			unstash(e->x.tag, e->x.tgz);
+			break;
+		case EV_ACC:
+			send_acc(e->m, e->a);
+			break;
+		case EV_MTM:
+			send_mtm(e->m, e->a, e->bid, e->ask);
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void
+push_exe(tv_t m, exe_t x)
+{
+	ev_t *e = ring_prod(evq);
+
+	/* the writer lets go of the tag */
+	restash(x.tag, x.tgz);
+	e->typ = EV_EXE;
+	e->m = m;
+	e->x = x;
+	ring_push(evq);
+	return;
+}
+
+static void
+push_rej(tv_t m, exe_t x, bool expd)
+{
+	ev_t *e = ring_prod(evq);
+
+	/* the writer lets go of the tag */
+	restash(x.tag, x.tgz);
+	e->typ = expd ? EV_EXP : EV_REJ;
+	e->m = m;
+	e->x = x;
+	ring_push(evq);
+	return;
+}
+
+static void
+push_mtm(tv_t m, acc_t a, px_t bid, px_t ask)
+{
+	ev_t *e = ring_prod(evq);
+
+	e->typ = EV_MTM;
+	e->m = m;
+	e->a = a;
+	e->bid = bid;
+	e->ask = ask;
+	ring_push(evq);
+	return;
+}
+
+static void
+push_acc(tv_t m, acc_t a)
+{
+	ev_t *e = ring_prod(evq);
+
+	e->typ = EV_ACC;
+	e->m = m;
+	e->a = a;
+	ring_push(evq);
+	return;
+}
+
+static void
+send_sum(sum_t s)
+{
+	static const char verb[] = "SUM\t";
+	tvpfx_t c = {0U};
+	char *buf = sink_get(out, orec);
+	const qx_t n = (qx_t)(long long)s.nfil;
+	const qx_t hit = s.ntrp
+		? (qx_t)(long long)s.nwin / (qx_t)(long long)s.ntrp : NANQX;
+	const tv_t y = s.nfil ? s.yngt / s.nfil : 0U;
+	const tv_t z = s.nfil ? s.oldt / s.nfil : 0U;
+	size_t len;
+
+	len = fld(buf, 0U, tvtostr_r(buf, orec, s.t, &c), FIXTV);
+	buf[len++] = '\t';
+	len += (memcpy(buf + len, cont, conz), conz);
+	buf[len++] = '\t';
+	len += (memcpy(buf + len, verb, strlenof(verb)), strlenof(verb));
+	/* pnl, max drawdown, turnover */
+	len = fld(buf, len,
+		  wxtostr(buf + len, orec - len, s.eqty), _glob_fixw);
+	buf[len++] = '\t';
+	len = fld(buf, len,
+		  wxtostr(buf + len, orec - len, s.mxdd), _glob_fixw);
+	buf[len++] = '\t';
+	len = fld(buf, len,
+		  wxtostr(buf + len, orec - len, s.turn), _glob_fixw);
+	/* fills, round trips, hit rate */
+	buf[len++] = '\t';
+	len = fld(buf, len,
+		  snprintf(buf + len, orec - len, "%zu", s.nfil), _glob_fixw);
+	buf[len++] = '\t';
+	len = fld(buf, len,
+		  snprintf(buf + len, orec - len, "%zu", s.ntrp), _glob_fixw);
+	buf[len++] = '\t';
+	len = fld(buf, len, qxtostr(buf + len, orec - len, hit), _glob_fixw);
+	/* average effective spread and liquidity ages */
+	buf[len++] = '\t';
+	len = fld(buf, len,
+		  qxtostr(buf + len, orec - len, wxtoqx(s.effs) / n), _glob_fixw);
+	buf[len++] = '\t';
+	len = fld(buf, len, tvtostr_r(buf + len, orec - len, y, &c), FIXTV);
+	buf[len++] = '\t';
+	len = fld(buf, len, tvtostr_r(buf + len, orec - len, z, &c), FIXTV);
+	len = eol(buf, len);
+	sink_put(out, len);
 	return;
 }
 
@@ -249,7 +935,10 @@ yield_ord(FILE *ofp)
 	hx_t h;
 
 retry:
-	if (UNLIKELY((nrd = getline(&line, &llen, ofp)) <= 0)) {
+	nrd = LIKELY(osrt == NULL)
+		? getline(&line, &llen, ofp)
+		: osort_getline(&line, &llen, osrt);
+	if (UNLIKELY(nrd <= 0)) {
 		free(line);
 		line = NULL;
 		llen = 0UL;
@@ -280,6 +969,19 @@ retry:
 		break;
 	}
 	r.o.t += _glob_age;
+	/* good-till-time orders expire at exchange time,
+	 * everything but IOCs is bounded by the maximum age */
+	if (_glob_maxage && r.tif != TIF_IOC &&
+	    (r.tif == TIF_GTC || r.exp > r.o.t + _glob_maxage)) {
+		r.tif = TIF_GTT;
+		r.exp = r.o.t + _glob_maxage;
+	}
+	/* move the tag off the line buffer */
+	if (r.tgz) {
+		r.tgz = r.tgz < MAXTAG ? r.tgz : MAXTAG;
+		r.tag = stash(r.tag, r.tgz);
+		r.tgz *= r.tag != NULL;
+	}
 	return r;
 }
 
@@ -322,149 +1024,1214 @@ retry:
 }
 
 static acc_t
-alloc(acc_t a, exe_t x, com_t c)
+alloc(acc_t a, exe_t x, wx_t q, com_t c)
 {
-/* allocate execution X to account A. */
+/* allocate execution X of quantity Q, in full precision, to account A.
+ * Everything is done in wide integers so accounts don't lose digits
+ * no matter how long the run, the scale is that of the finest fill so
+ * far but no finer than WXMINE */
 	if (LIKELY(!isnanpx(x.p))) {
+		const wx_t aq = fabswx(q);
+		const wx_t qp = mul_wx(q, pxtowx(x.p));
+
 		/* calc accounts */
-		a.base += x.q;
-		a.term -= x.q * x.p;
-		a.comm -= fabsqx(x.q) * c.base;
-		a.comm -= fabsqx(x.q * x.p) * c.term;
-		a.effs -= fabsqx(x.q) * x.e;
+		a.base = add_wx(a.base, q);
+		a.term = add_wx(a.term, neg_wx(qp));
+		a.comm = add_wx(a.comm, neg_wx(mul_wx(aq, pxtowx(c.base))));
+		a.comm = add_wx(a.comm, neg_wx(mul_wx(fabswx(qp), pxtowx(c.term))));
+		a.effs = add_wx(a.effs, neg_wx(mul_wx(aq, pxtowx(x.e))));
 		a.yngt += x.y;
 		a.oldt += x.z;
 	}
 	return a;
 }
 
-
-static int
-offline(FILE *qfp)
+static sum_t
+tally(sum_t s, tv_t m, acc_t a, exe_t x, px_t bid, px_t ask)
 {
-	xord_t _oq[256U], *oq = _oq;
-	size_t ioq = 0U, noq = 0U, zoq = countof(_oq);
-	tv_t metr = 0U;
-	acc_t a = {
-		.base = 0.dd, .term = 0.dd, .comm = 0.dd, .effs = 0.dd,
-	};
-	book_t b;
-
-	b = make_book();
-
-	/* we can't do nothing before the first quote, so read that one
-	 * as a reference and fast forward orders beyond that point */
-	for (xquo_t q; (q = yield_quo(qfp), true); metr = q.o.t) {
-	ord:
-		if (UNLIKELY(stdin == NULL)) {
-			/* order file is eof'd, skip fetching more */
-			goto exe;
-		}
-		for (xord_t o;
-		     noq < zoq && !NOT_A_XORD_P(o = yield_ord(stdin));
-		     oq[noq++] = o);
-		if (noq < zoq) {
-			/* out of orders, shut him up */
-			fclose(stdin);
-			stdin = NULL;
-		}
-
-	exe:
-		if (NOT_A_XQUO_P(q) && a.base) {
-			/* inject a CANCEL order */
-			const ord_t o = {
-				ORD_MKT, BOOK_SIDE_CLR,
-				.qty = 0.dd, .lmt = NANPX, .t = metr
-			};
-			oq[noq++] = (xord_t){ao(o, a), cont, conz};
-			q.o.t = NATV;
-		}
-		/* go through order queue and try exec'ing @q */
-		for (size_t i = ioq; i < noq && oq[i].o.t < q.o.t; i++) {
-			const ord_t o = ao(oq[i].o, a);
-			book_pdo_t d = book_pdo(b, o.sid, o.qty, o.lmt);
-
-			if (UNLIKELY(d.base <= 0.dd)) {
-				continue;
-			}
+/* update statistics S with execution X at M that led to account A,
+ * marking the position to the mid of BID and ASK */
+	if (UNLIKELY(isnanpx(x.p))) {
+		return s;
+	} else if (LIKELY(!isnanpx(bid) && !isnanpx(ask))) {
+		/* the mid is exact in wide integers */
+		static const wx_t half = {5, -1};
+		s.mid = mul_wx(add_wx(pxtowx(bid), pxtowx(ask)), half);
+	}
+	s.nfil++;
+	s.t = m;
+	s.turn = add_wx(s.turn, fabswx(mul_wx(qxtowx(x.q), pxtowx(x.p))));
+	s.effs = add_wx(s.effs, pxtowx(x.e));
+	s.yngt += x.y;
+	s.oldt += x.z;
 
-			book_pdo_t c = book_pdo(b, contra(o.sid), o.qty, NANPX);
-			book_quo_t topb = book_top(b, BOOK_SIDE_BID);
-			book_quo_t topa = book_top(b, BOOK_SIDE_ASK);
-			tra_t trad = pdo2tra(d, o.sid);
-			tra_t trac = pdo2tra(c, contra(o.sid));
-			exe_t x;
-
-			/* copy prices */
-			x.p = trad.p;
-			x.q = trad.q;
-
-			/* calc spreads */
-			x.s = topa.p - topb.p;
-			x.e = fabspx(trac.p - trad.p);
-
-			/* calc age */
-			metr = max_tv(metr, o.t);
-			x.y = d.yngt > 0U ? metr - d.yngt : 0U;
-			x.z = d.oldt < NATV ? metr - d.oldt : 0U;
-
-			send_exe(metr, x);
-			if (o.qty - d.base <= 0.dd) {
-				/* mark executed */
-				oq[i].o.t = NATV;
-			} else if (oq[i].o.qty > 0.dd) {
-				oq[i].o.qty -= d.base;
-			}
+	if (UNLIKELY(NOT_A_WX_P(s.mid))) {
+		/* can't mark to market without a mid */
+		return s;
+	}
+	with (int sgn = (a.base.m > 0) - (a.base.m < 0)) {
+		const wx_t pos = a.base.m ? mul_wx(a.base, s.mid) : a.base;
 
-			/* allocate */
-			a = alloc(a, x, _glob_com);
-			send_acc(metr, a);
-		}
-		if (NOT_A_XQUO_P(q)) {
-			break;
+		s.eqty = add_wx(add_wx(a.term, a.comm), pos);
+		if (add_wx(s.eqty, neg_wx(s.peak)).m > 0) {
+			s.peak = s.eqty;
 		}
-		/* fast forward dead orders */
-		for (; ioq < noq && oq[ioq].o.t == NATV; ioq++);
-		/* gc'ing again */
-		if (UNLIKELY(ioq >= zoq / 2U)) {
-			memmove(oq, oq + ioq, (noq - ioq) * sizeof(*oq));
-			noq -= ioq;
-			ioq = 0U;
-		}
-		if (UNLIKELY(stdin == NULL)) {
-			/* order file is eof'd, skip fetching more */
-			;
-		} else if (UNLIKELY(!noq)) {
-			/* fill up the queue some more and do more exec'ing */
-			goto ord;
-		} else if (oq[noq - 1U].o.t < q.o.t) {
-			/* there could be more orders between then and Q
-			 * try exec'ing those as well */
-			if (UNLIKELY(noq >= ioq + zoq / 2U)) {
-				/* resize :( */
-				xord_t *nuq = malloc((zoq *= 16U) * sizeof(*oq));
-				memcpy(nuq, oq + ioq, (noq - ioq) * sizeof(*oq));
-				noq -= ioq;
-				ioq = 0U;
-				if (oq != _oq) {
-					free(oq);
-				}
-				oq = nuq;
+		with (wx_t dd = add_wx(s.peak, neg_wx(s.eqty))) {
+			if (add_wx(dd, neg_wx(s.mxdd)).m > 0) {
+				s.mxdd = dd;
 			}
-			goto ord;
 		}
-
-		/* at last build up new book */
-		book_add(b, q.o);
-		if (q.r.s) {
-			book_add(b, q.r);
+		if (s.sgn && sgn != s.sgn) {
+			/* position closed or flipped, that's a round trip */
+			s.nwin += add_wx(s.eqty, neg_wx(s.flat)).m > 0;
+			s.ntrp++;
+			s.flat = s.eqty;
 		}
+		s.sgn = sgn;
 	}
-	free_book(b);
-	return 0;
+	return s;
+}
+
+static tv_t
+mtm(tv_t g, tv_t t, acc_t a, book_t b)
+{
+/* mark account A to market at every grid point from G up to but
+ * excluding T, return the next grid point */
+	if (UNLIKELY(!g)) {
+		/* first call, start the grid after T */
+		return (t / _glob_mtm + 1U) * _glob_mtm;
+	} else if (LIKELY(g >= t)) {
+		return g;
+	}
+	with (px_t bid = book_top(b, BOOK_SIDE_BID).p,
+	      ask = book_top(b, BOOK_SIDE_ASK).p) {
+		for (; g < t; g += _glob_mtm) {
+			push_mtm(g, a, bid, ask);
+		}
+	}
+	return g;
+}
+
+/* book queries memoised for as long as the book stays the same */
+#define NPDOM	(16U)
+typedef struct {
+	size_t ep;
+	book_side_t sid;
+	qx_t q;
+	px_t l;
+	book_pdo_t d;
+} pdom_t;
+
+/* simulator state */
+typedef struct {
+	book_t b;
+	acc_t a;
+	/* metronome */
+	tv_t metr;
+	/* next mark-to-market grid point */
+	tv_t mtmg;
+	/* version per side, renewed from the clock whenever the side
+	 * or the account changes, and the last quote seen on the side */
+	size_t clk;
+	size_t ver[NBOOK_SIDES];
+	book_quo_t last[NBOOK_SIDES];
+	/* book epoch, bumped with every quote added to the book,
+	 * and the tops and PDOs queried during the current one */
+	size_t ep;
+	size_t tep[NBOOK_SIDES];
+	book_quo_t top[NBOOK_SIDES];
+	pdom_t pdom[NPDOM];
+} sim_t;
+
+/* arrival queue, a ring of Z slots, Z being a power of 2,
+ * head I and tail N run freely and are masked on access,
+ * arrival times are kept in a column of their own so that
+ * the due test runs over dense memory */
+#define MAXOQ	(1U << 20U)
+typedef struct {
+	tv_t *t;
+	xord_t *o;
+	size_t z;
+	size_t i;
+	size_t n;
+	tv_t _t[256U];
+	xord_t _o[256U];
+} oq_t;
+
+static inline bool
+oq_empty(const oq_t *q)
+{
+	return q->i == q->n;
+}
+
+static inline bool
+oq_full(const oq_t *q)
+{
+	return q->n - q->i >= q->z;
+}
+
+static inline xord_t*
+oq_at(oq_t *q, size_t k)
+{
+	return q->o + (k & (q->z - 1U));
+}
+
+static inline tv_t
+oq_tat(const oq_t *q, size_t k)
+{
+	return q->t[k & (q->z - 1U)];
+}
+
+static inline void
+oq_push(oq_t *q, xord_t o)
+{
+	const size_t k = q->n++ & (q->z - 1U);
+
+	q->t[k] = o.o.t;
+	q->o[k] = o;
+	return;
+}
+
+static size_t
+oq_due(const oq_t *q, tv_t t)
+{
+/* return the number of orders at the head of Q that arrived before T */
+	size_t k = q->i;
+
+	while (k < q->n) {
+		/* contiguous stretch of slots [m, e) */
+		const size_t m = k & (q->z - 1U);
+		const size_t e = m + min(q->n - k, q->z - m);
+		const tv_t *ts = q->t;
+		size_t j = m;
+
+		/* blocks of 8 without branching on single slots */
+		for (; j + 8U <= e; j += 8U) {
+			unsigned int x = 0U;
+
+			for (size_t l = 0U; l < 8U; l++) {
+				x |= ts[j + l] >= t;
+			}
+			if (x) {
+				break;
+			}
+		}
+		for (; j < e && ts[j] < t; j++);
+		k += j - m;
+		if (j < e) {
+			break;
+		}
+	}
+	return k - q->i;
+}
+
+static void
+oq_unwrap(void *restrict tgt, const void *src,
+	  size_t m, size_t k, size_t z, size_t sz)
+{
+/* copy K slots of size SZ starting at slot M of the Z-ring SRC to TGT */
+	if (m + k <= z) {
+		memcpy(tgt, (const char*)src + m * sz, k * sz);
+	} else {
+		memcpy(tgt, (const char*)src + m * sz, (z - m) * sz);
+		memcpy((char*)tgt + (z - m) * sz, src, (m + k - z) * sz);
+	}
+	return;
+}
+
+static int
+oq_grow(oq_t *q)
+{
+/* double the capacity of Q, unless that exceeds MAXOQ */
+	const size_t nuz = q->z * 2U;
+	const size_t m = q->i & (q->z - 1U);
+	const size_t k = q->n - q->i;
+	xord_t *nuo;
+	tv_t *nut;
+
+	if (UNLIKELY(nuz > MAXOQ)) {
+		return -1;
+	}
+	/* times go behind the orders in the same chunk */
+	nuo = malloc(nuz * (sizeof(*nuo) + sizeof(*nut)));
+	if (UNLIKELY(nuo == NULL)) {
+		return -1;
+	}
+	nut = (tv_t*)(nuo + nuz);
+	/* unwrap into the new ring */
+	oq_unwrap(nuo, q->o, m, k, q->z, sizeof(*nuo));
+	oq_unwrap(nut, q->t, m, k, q->z, sizeof(*nut));
+	if (q->o != q->_o) {
+		free(q->o);
+	}
+	q->o = nuo;
+	q->t = nut;
+	q->z = nuz;
+	q->i = 0U;
+	q->n = k;
+	return 0;
+}
+
+static void
+oq_gc(oq_t *q)
+{
+/* go back to the inline slots once Q is drained */
+	if (UNLIKELY(q->o != q->_o) && oq_empty(q)) {
+		free(q->o);
+		q->o = q->_o;
+		q->t = q->_t;
+		q->z = countof(q->_o);
+		q->i = q->n = 0U;
+	}
+	return;
+}
+
+/* pending orders, the arrival sequence gives time priority */
+typedef struct {
+	xord_t x;
+	size_t seq;
+	/* expiry ticket, 0 for none */
+	size_t tix;
+	/* version of the side at the last failed attempt */
+	size_t ver;
+} pord_t;
+
+/* a growable vector of pending orders, used as FIFO or as heap */
+typedef struct {
+	pord_t *o;
+	size_t n;
+	size_t z;
+} pq_t;
+
+static int
+pq_add(pq_t *q, pord_t o)
+{
+	if (UNLIKELY(q->n >= q->z)) {
+		const size_t nuz = q->z * 2U ?: 64U;
+		pord_t *nuo = realloc(q->o, nuz * sizeof(*q->o));
+
+		if (UNLIKELY(nuo == NULL)) {
+			return -1;
+		}
+		q->o = nuo;
+		q->z = nuz;
+	}
+	q->o[q->n++] = o;
+	return 0;
+}
+
+static void
+free_pq(pq_t *q)
+{
+	free(q->o);
+	q->o = NULL;
+	q->n = q->z = 0U;
+	return;
+}
+
+static inline bool
+pq_prio(const pord_t *x, const pord_t *y)
+{
+/* whether limit order X goes before Y, both being on the same side,
+ * buy orders (taking the ASK side) by descending limit, sell orders by
+ * ascending limit, and in order of arrival at the same limit */
+	if (x->x.o.lmt != y->x.o.lmt) {
+		return x->x.o.sid == BOOK_SIDE_ASK
+			? x->x.o.lmt > y->x.o.lmt
+			: x->x.o.lmt < y->x.o.lmt;
+	}
+	return x->seq < y->seq;
+}
+
+static int
+pq_push(pq_t *q, pord_t o)
+{
+/* heap insert */
+	size_t i;
+
+	if (UNLIKELY(pq_add(q, o) < 0)) {
+		return -1;
+	}
+	for (i = q->n - 1U; i > 0U; ) {
+		const size_t p = (i - 1U) / 2U;
+
+		if (!pq_prio(&o, q->o + p)) {
+			break;
+		}
+		q->o[i] = q->o[p];
+		i = p;
+	}
+	q->o[i] = o;
+	return 0;
+}
+
+static void
+pq_sift(pq_t *q, size_t i, pord_t o)
+{
+/* put O into slot I and let it sink below its children */
+	for (size_t c; (c = 2U * i + 1U) < q->n; i = c) {
+		if (c + 1U < q->n && pq_prio(q->o + c + 1U, q->o + c)) {
+			c++;
+		}
+		if (!pq_prio(q->o + c, &o)) {
+			break;
+		}
+		q->o[i] = q->o[c];
+	}
+	q->o[i] = o;
+	return;
+}
+
+static pord_t
+pq_pop(pq_t *q)
+{
+/* heap removal of the top, Q must not be empty */
+	const pord_t top = q->o[0U];
+
+	pq_sift(q, 0U, q->o[--q->n]);
+	return top;
+}
+
+static int
+pq_cmp_seq(const void *x, const void *y)
+{
+	const pord_t *ox = x, *oy = y;
+	return (ox->seq > oy->seq) - (ox->seq < oy->seq);
+}
+
+/* expiry tickets, shared by a pending order and its timer,
+ * the slot is recycled when both have let go of it */
+typedef struct {
+	union {
+		/* the order as it stands */
+		xord_t x;
+		/* next free slot */
+		size_t nxt;
+	};
+	unsigned int ref;
+	/* filled or expired */
+	bool dead;
+} tkt_t;
+
+/* timers, by expiry and in order of arrival at the same expiry */
+typedef struct {
+	tv_t exp;
+	size_t seq;
+	size_t tix;
+} tmr_t;
+
+typedef struct {
+	/* tickets, slot 0 is unused, and the head of the free list */
+	tkt_t *k;
+	size_t nk;
+	size_t zk;
+	size_t fk;
+	/* timer heap */
+	tmr_t *t;
+	size_t nt;
+	size_t zt;
+	/* expired orders still sitting in the pending queues */
+	size_t nzomb;
+} xp_t;
+
+static void
+xp_unref(xp_t *xp, size_t i)
+{
+	if (!--xp->k[i].ref) {
+		xp->k[i].nxt = xp->fk;
+		xp->fk = i;
+	}
+	return;
+}
+
+static inline bool
+tmr_prio(const tmr_t *x, const tmr_t *y)
+{
+	return x->exp < y->exp || x->exp == y->exp && x->seq < y->seq;
+}
+
+static int
+xp_arm(xp_t *xp, tmr_t m)
+{
+/* heap insert */
+	size_t i;
+
+	if (UNLIKELY(xp->nt >= xp->zt)) {
+		const size_t nuz = xp->zt * 2U ?: 64U;
+		tmr_t *nut = realloc(xp->t, nuz * sizeof(*xp->t));
+
+		if (UNLIKELY(nut == NULL)) {
+			return -1;
+		}
+		xp->t = nut;
+		xp->zt = nuz;
+	}
+	for (i = xp->nt++; i > 0U; ) {
+		const size_t p = (i - 1U) / 2U;
+
+		if (!tmr_prio(&m, xp->t + p)) {
+			break;
+		}
+		xp->t[i] = xp->t[p];
+		i = p;
+	}
+	xp->t[i] = m;
+	return 0;
+}
+
+static tmr_t
+xp_pop(xp_t *xp)
+{
+/* heap removal of the top, there must be timers */
+	const tmr_t top = xp->t[0U];
+	const tmr_t m = xp->t[--xp->nt];
+	size_t i = 0U;
+
+	for (size_t c; (c = 2U * i + 1U) < xp->nt; i = c) {
+		if (c + 1U < xp->nt && tmr_prio(xp->t + c + 1U, xp->t + c)) {
+			c++;
+		}
+		if (!tmr_prio(xp->t + c, &m)) {
+			break;
+		}
+		xp->t[i] = xp->t[c];
+	}
+	xp->t[i] = m;
+	return top;
+}
+
+static int
+xp_add(xp_t *xp, pord_t *o)
+{
+/* give O a ticket and set its timer */
+	size_t i;
+
+	if (xp->fk) {
+		i = xp->fk;
+		xp->fk = xp->k[i].nxt;
+	} else if (UNLIKELY(xp->nk >= xp->zk)) {
+		const size_t nuz = xp->zk * 2U ?: 64U;
+		tkt_t *nuk = realloc(xp->k, nuz * sizeof(*xp->k));
+
+		if (UNLIKELY(nuk == NULL)) {
+			return -1;
+		}
+		xp->k = nuk;
+		xp->zk = nuz;
+		i = xp->nk++;
+	} else {
+		i = xp->nk++;
+	}
+	xp->k[i] = (tkt_t){.x = o->x, .ref = 2U};
+	if (UNLIKELY(xp_arm(xp, (tmr_t){o->x.exp, o->seq, i}) < 0)) {
+		xp->k[i].ref = 1U;
+		xp_unref(xp, i);
+		return -1;
+	}
+	o->tix = i;
+	return 0;
+}
+
+static inline bool
+xp_zomb(xp_t *xp, const pord_t *o)
+{
+/* whether O has expired, if so let go of its ticket */
+	if (LIKELY(!o->tix) || !xp->k[o->tix].dead) {
+		return false;
+	}
+	xp->nzomb--;
+	xp_unref(xp, o->tix);
+	return true;
+}
+
+static void
+pq_sweep(pq_t *q, xp_t *xp, bool heap)
+{
+/* drop expired orders from Q, rebuild the heap if Q is one */
+	size_t n = 0U;
+
+	for (size_t i = 0U; i < q->n; i++) {
+		if (!xp_zomb(xp, q->o + i)) {
+			q->o[n++] = q->o[i];
+		}
+	}
+	q->n = n;
+	for (size_t i = heap ? n / 2U : 0U; i-- > 0U; ) {
+		pq_sift(q, i, q->o[i]);
+	}
+	return;
+}
+
+static int
+park(pq_t mq[static NBOOK_SIDES], pq_t lq[static NBOOK_SIDES], pord_t o)
+{
+/* keep limit orders by price, and market and CANCEL orders by arrival,
+ * everything by side */
+	if (o.x.o.typ == ORD_LMT && !isnanpx(o.x.o.lmt) &&
+	    o.x.o.sid != BOOK_SIDE_CLR) {
+		return pq_push(lq + o.x.o.sid, o);
+	}
+	return pq_add(mq + o.x.o.sid, o);
+}
+
+static void
+sim_add(sim_t *s, book_quo_t q)
+{
+/* add Q to the book, restatements of the last quote on a side
+ * only refresh time stamps and leave the side's version alone */
+	switch (q.s) {
+	case BOOK_SIDE_ASK:
+	case BOOK_SIDE_BID:
+		if (q.f == s->last[q.s].f &&
+		    q.p == s->last[q.s].p && q.q == s->last[q.s].q) {
+			break;
+		}
+		s->last[q.s] = q;
+		s->ver[q.s] = ++s->clk;
+		break;
+	default:
+		s->ver[BOOK_SIDE_ASK] = s->ver[BOOK_SIDE_BID] = ++s->clk;
+		break;
+	}
+	book_add(s->b, q);
+	s->ep++;
+	return;
+}
+
+static book_quo_t
+sim_top(sim_t *s, book_side_t sid)
+{
+/* book_top() but memoised */
+	if (s->tep[sid] != s->ep) {
+		s->top[sid] = book_top(s->b, sid);
+		s->tep[sid] = s->ep;
+	}
+	return s->top[sid];
+}
+
+static book_pdo_t
+sim_pdo(sim_t *s, book_side_t sid, qx_t q, px_t l)
+{
+/* book_pdo() but memoised, by the bit patterns of Q and L */
+	uint_least64_t kq = 0U, kl = 0U;
+	pdom_t *m;
+
+	memcpy(&kq, &q, sizeof(q));
+	memcpy(&kl, &l, sizeof(l));
+	with (uint_least64_t h = kq ^ kl * 0x9e3779b97f4a7c15ULL ^ sid) {
+		h *= 0x9e3779b97f4a7c15ULL;
+		m = s->pdom + (h >> 60U) % NPDOM;
+	}
+	if (m->ep != s->ep || m->sid != sid ||
+	    memcmp(&m->q, &q, sizeof(q)) || memcmp(&m->l, &l, sizeof(l))) {
+		m->ep = s->ep;
+		m->sid = sid;
+		m->q = q;
+		m->l = l;
+		m->d = book_pdo(s->b, sid, q, l);
+	}
+	return m->d;
+}
+
+static void
+fill(sim_t *restrict s, exe_t e, wx_t q, px_t bid, px_t ask)
+{
+/* report execution E and allocate it with quantity Q in full precision,
+ * BID and ASK being the top */
+	if (_glob_emit & EMIT_EXE) {
+		push_exe(s->metr, e);
+	}
+
+	/* allocate */
+	s->a = alloc(s->a, e, q, _glob_com);
+	/* CANCEL orders depend on the position */
+	s->ver[BOOK_SIDE_ASK] = s->ver[BOOK_SIDE_BID] = ++s->clk;
+	if (_glob_emit & EMIT_ACC) {
+		push_acc(s->metr, s->a);
+	}
+	if (_glob_summ) {
+		summ = tally(summ, s->metr, s->a, e, bid, ask);
+	}
+	return;
+}
+
+static bool
+exe1(sim_t *restrict s, xord_t *restrict x)
+{
+/* try and execute order X against the book,
+ * return true if it has been executed in full */
+	const ord_t o = ao(x->o, s->a);
+
+	if (UNLIKELY(_glob_maxq || _glob_absq) &&
+	    x->o.sid != BOOK_SIDE_CLR && o.qty <= 0.dd) {
+		/* the position is where O wants it already */
+		return true;
+	}
+
+	book_pdo_t d = sim_pdo(s, o.sid, o.qty, o.lmt);
+
+	if (UNLIKELY(d.base <= 0.dd)) {
+		return false;
+	}
+
+	book_quo_t topb = sim_top(s, BOOK_SIDE_BID);
+	book_quo_t topa = sim_top(s, BOOK_SIDE_ASK);
+	tra_t trad = pdo2tra(d, o.sid);
+	exe_t e;
+
+	/* copy prices */
+	e.p = trad.p;
+	e.q = trad.q;
+	e.tag = x->tag;
+	e.tgz = x->tgz;
+
+	/* calc spreads */
+	e.s = topa.p - topb.p;
+	if (LIKELY(!_glob_noeffs)) {
+		/* what the same quantity would have fetched on the other side */
+		book_pdo_t c = sim_pdo(s, contra(o.sid), o.qty, NANPX);
+		tra_t trac = pdo2tra(c, contra(o.sid));
+
+		e.e = fabspx(trac.p - trad.p);
+	} else {
+		e.e = NANPX;
+	}
+
+	/* calc age */
+	s->metr = max_tv(s->metr, o.t);
+	if (_glob_mtm) {
+		s->mtmg = mtm(s->mtmg, s->metr, s->a, s->b);
+	}
+	e.y = d.yngt > 0U ? s->metr - d.yngt : 0U;
+	e.z = d.oldt < NATV ? s->metr - d.oldt : 0U;
+
+	if (x->o.sid == BOOK_SIDE_CLR && !(x->o.qty > 0.dd) &&
+	    o.qty - d.base <= 0.dd) {
+		/* the CANCEL was sized in the 16 digits of a qx_t,
+		 * what it closes is the position to the last digit */
+		fill(s, e, neg_wx(s->a.base), topb.p, topa.p);
+	} else {
+		fill(s, e, qxtowx(e.q), topb.p, topa.p);
+	}
+
+	if (o.qty - d.base <= 0.dd) {
+		return true;
+	} else if (x->o.qty > 0.dd && !_glob_absq) {
+		/* positions asked for stay the same */
+		x->o.qty -= d.base;
+	}
+	return false;
+}
+
+static inline bool
+alike_p(const xord_t *x, const xord_t *y)
+{
+/* whether X and Y can go into the same walk of the book, bar timing */
+	return x->o.sid == y->o.sid && x->o.typ == y->o.typ &&
+		(x->o.lmt == y->o.lmt ||
+		 isnanpx(x->o.lmt) && isnanpx(y->o.lmt)) &&
+		/* CANCELs depend on the position, and so do
+		 * capped or absolute quantities */
+		x->o.sid != BOOK_SIDE_CLR &&
+		x->o.qty > 0.dd && y->o.qty > 0.dd &&
+		!_glob_maxq && !_glob_absq;
+}
+
+static inline bool
+coal_p(const xord_t *x, const xord_t *y)
+{
+/* whether Y, just arrived, can go into the same walk of the book as X */
+	return x->o.t == y->o.t && alike_p(x, y) &&
+		(y->tif != TIF_GTT || y->exp >= y->o.t);
+}
+
+static size_t
+nalike(const pord_t *o, size_t n, size_t v)
+{
+/* return the number of orders at the head of the N pending orders O
+ * that can go into one walk of the book, all of them being due for
+ * another try at side version V */
+	size_t k = 1U;
+
+	for (; k < n && o[k].ver != v && alike_p(&o->x, &o[k].x); k++);
+	return k;
+}
+
+static void
+exen(sim_t *restrict s, pord_t *restrict o, size_t n)
+{
+/* execute the N orders O, alike as per coal_p(), in one walk of the
+ * book for their total quantity, share the fill among them and leave
+ * their unfilled remainders in O */
+	const ord_t x = o->x.o;
+	qx_t tot = 0.dd;
+
+	for (size_t i = 0U; i < n; i++) {
+		tot += o[i].x.o.qty;
+	}
+
+	book_pdo_t d = sim_pdo(s, x.sid, tot, x.lmt);
+
+	if (UNLIKELY(d.base <= 0.dd)) {
+		return;
+	}
+
+	book_quo_t topb = sim_top(s, BOOK_SIDE_BID);
+	book_quo_t topa = sim_top(s, BOOK_SIDE_ASK);
+	tra_t trad = pdo2tra(d, x.sid);
+	qx_t left = d.base;
+	exe_t e;
+
+	/* everyone gets the average price */
+	e.p = trad.p;
+	e.s = topa.p - topb.p;
+	if (LIKELY(!_glob_noeffs)) {
+		book_pdo_t c = sim_pdo(s, contra(x.sid), tot, NANPX);
+		tra_t trac = pdo2tra(c, contra(x.sid));
+
+		e.e = fabspx(trac.p - trad.p);
+	} else {
+		e.e = NANPX;
+	}
+
+	s->metr = max_tv(s->metr, x.t);
+	if (_glob_mtm) {
+		s->mtmg = mtm(s->mtmg, s->metr, s->a, s->b);
+	}
+	e.y = d.yngt > 0U ? s->metr - d.yngt : 0U;
+	e.z = d.oldt < NATV ? s->metr - d.oldt : 0U;
+
+	for (size_t i = 0U; i < n && left > 0.dd; i++) {
+		const qx_t q = o[i].x.o.qty;
+		qx_t f = q;
+
+		if (d.base >= tot) {
+			/* filled in full */
+			;
+		} else if (_glob_coal == COAL_PRORATA && i + 1U < n) {
+			f = min(d.base * q / tot, left);
+		} else {
+			/* first come first served, and under pro rata
+			 * the last one gets what is left */
+			f = min(q, left);
+		}
+		if (f <= 0.dd) {
+			continue;
+		}
+		left -= f;
+		o[i].x.o.qty = q - f;
+		e.q = x.sid == BOOK_SIDE_BID ? -f : f;
+		e.tag = o[i].x.tag;
+		e.tgz = o[i].x.tgz;
+		fill(s, e, qxtowx(e.q), topb.p, topa.p);
+	}
+	return;
+}
+
+static inline void
+retire(const xord_t *x)
+{
+/* X is done with, filled, rejected or expired, let go of its tag */
+	unstash(x->tag, x->tgz);
+	return;
+}
+
+static void
+rest(sim_t *restrict s, tv_t t, const xord_t *restrict x, bool expd)
+{
+/* report the unfilled remainder of order X at T, as REJ if it never
+ * made it into the book, or as EXP if it timed out there */
+	const ord_t o = ao(x->o, s->a);
+	const px_t topb = sim_top(s, BOOK_SIDE_BID).p;
+	const px_t topa = sim_top(s, BOOK_SIDE_ASK).p;
+	const exe_t e = {
+		.q = o.sid == BOOK_SIDE_BID ? -o.qty : o.qty,
+		.p = o.lmt, .s = topa - topb, .e = NANPX,
+		.tag = x->tag, .tgz = x->tgz,
+	};
+
+	s->metr = max_tv(s->metr, t);
+	if (_glob_mtm) {
+		s->mtmg = mtm(s->mtmg, s->metr, s->a, s->b);
+	}
+	if (_glob_emit & EMIT_EXP) {
+		push_rej(s->metr, e, expd);
+	}
+	return;
+}
+
+static void
+xp_fire(sim_t *restrict s, xp_t *restrict xp, tv_t t)
+{
+/* retire orders that expire at or before T, their copies in the
+ * pending queues are dropped when next seen */
+	while (xp->nt && xp->t->exp <= t) {
+		const tmr_t m = xp_pop(xp);
+		tkt_t *k = xp->k + m.tix;
+
+		if (!k->dead) {
+			rest(s, m.exp, &k->x, true);
+			retire(&k->x);
+			k->dead = true;
+			xp->nzomb++;
+		}
+		xp_unref(xp, m.tix);
+	}
+	return;
+}
+
+static int
+repark(xp_t *restrict xp,
+       pq_t mq[static NBOOK_SIDES], pq_t lq[static NBOOK_SIDES],
+       pord_t *o, size_t v, bool done)
+{
+/* after another try of pending order O at side version V, retire it
+ * if DONE, or park what's left of it */
+	if (done) {
+		retire(&o->x);
+		if (o->tix) {
+			xp->k[o->tix].dead = true;
+			xp_unref(xp, o->tix);
+		}
+		return 0;
+	}
+	/* partial fills bump the version, so the remainder is tried again */
+	o->ver = v;
+	if (o->tix) {
+		/* keep the ticket up to date */
+		xp->k[o->tix].x = o->x;
+	}
+	return park(mq, lq, *o);
+}
+
+static int
+settle(sim_t *restrict s, xp_t *restrict xp,
+       pq_t mq[static NBOOK_SIDES], pq_t lq[static NBOOK_SIDES], pord_t o)
+{
+/* deal with the unfilled remainder of O right after its arrival */
+	int rc = 0;
+
+	if (o.x.tif == TIF_IOC) {
+		/* no parking for IOCs */
+		rest(s, o.x.o.t, &o.x, false);
+		retire(&o.x);
+		return 0;
+	} else if (o.x.tif == TIF_GTT) {
+		rc |= xp_add(xp, &o);
+	}
+	return rc | park(mq, lq, o);
+}
+
+
+
+static int
+offline(FILE *qfp)
+{
+	/* arrival queue, orders that aren't due yet */
+	oq_t oq;
+	/* pending orders, market orders in FIFOs and limit orders in heaps
+	 * by side, and a scratch vector for the ones worth a try */
+	pq_t mq[NBOOK_SIDES] = {{NULL}}, lq[NBOOK_SIDES] = {{NULL}};
+	pq_t cq = {NULL};
+	/* side versions when the FIFOs were last looked at */
+	size_t seen[NBOOK_SIDES] = {0U};
+	size_t seq = 0U;
+	/* expiry tickets and timers, for orders with a time limit */
+	xp_t xp = {.nk = 1U};
+	sim_t s = {
+		.a = {
+			.base = {0, 0}, .term = {0, 0},
+			.comm = {0, 0}, .effs = {0, 0},
+		},
+	};
+	int rc = 0;
+
+	/* epoch 0 marks the memo slots unused */
+	s.ep = 1U;
+	oq.o = oq._o;
+	oq.t = oq._t;
+	oq.z = countof(oq._o);
+	oq.i = oq.n = 0U;
+	s.b = make_book();
+
+	/* we can't do nothing before the first quote, so read that one
+	 * as a reference and fast forward orders beyond that point */
+	for (xquo_t q; (q = yield_quo(qfp), true); s.metr = q.o.t) {
+		/* pending orders are older than anything in the queue,
+		 * try market orders on sides that have changed since,
+		 * and those whose limits cross the top of book,
+		 * in the order they came in */
+		with (const px_t topa = sim_top(&s, BOOK_SIDE_ASK).p,
+		      topb = sim_top(&s, BOOK_SIDE_BID).p) {
+			const bool da =
+				s.ver[BOOK_SIDE_ASK] != seen[BOOK_SIDE_ASK];
+			const bool db =
+				s.ver[BOOK_SIDE_BID] != seen[BOOK_SIDE_BID];
+			const bool dirt[NBOOK_SIDES] = {
+				[BOOK_SIDE_ASK] = da,
+				[BOOK_SIDE_BID] = db,
+				/* CANCELs go either way */
+				[BOOK_SIDE_CLR] = da || db,
+			};
+
+			cq.n = 0U;
+			for (size_t j = 0U; j < countof(mq); j++) {
+				if (!dirt[j]) {
+					continue;
+				}
+				for (size_t i = 0U; i < mq[j].n; i++) {
+					if (!xp_zomb(&xp, mq[j].o + i)) {
+						rc |= pq_add(&cq, mq[j].o[i]);
+					}
+				}
+				mq[j].n = 0U;
+			}
+			seen[BOOK_SIDE_ASK] = s.ver[BOOK_SIDE_ASK];
+			seen[BOOK_SIDE_BID] = s.ver[BOOK_SIDE_BID];
+			while (lq[BOOK_SIDE_ASK].n &&
+			       lq[BOOK_SIDE_ASK].o->x.o.lmt >= topa) {
+				const pord_t o = pq_pop(lq + BOOK_SIDE_ASK);
+
+				if (!xp_zomb(&xp, &o)) {
+					rc |= pq_add(&cq, o);
+				}
+			}
+			while (lq[BOOK_SIDE_BID].n &&
+			       lq[BOOK_SIDE_BID].o->x.o.lmt <= topb) {
+				const pord_t o = pq_pop(lq + BOOK_SIDE_BID);
+
+				if (!xp_zomb(&xp, &o)) {
+					rc |= pq_add(&cq, o);
+				}
+			}
+		}
+		if (cq.n > 1U) {
+			qsort(cq.o, cq.n, sizeof(*cq.o), pq_cmp_seq);
+		}
+		for (size_t i = 0U, ng; i < cq.n; i++) {
+			pord_t *o = cq.o + i;
+			const size_t v = s.ver[ao(o->x.o, s.a).sid];
+
+			if (o->ver == v) {
+				/* nothing's changed since the last try */
+				rc |= park(mq, lq, *o);
+			} else if (_glob_coal &&
+				   (ng = nalike(o, cq.n - i, v)) > 1U) {
+				/* walk the book once for O and its likes */
+				exen(&s, o, ng);
+				for (size_t j = 0U; j < ng; j++) {
+					rc |= repark(&xp, mq, lq, o + j, v,
+						     !(o[j].x.o.qty > 0.dd));
+				}
+				i += ng - 1U;
+			} else {
+				rc |= repark(&xp, mq, lq, o, v, exe1(&s, &o->x));
+			}
+		}
+
+	ord:
+		if (UNLIKELY(stdin == NULL)) {
+			/* order file is eof'd, skip fetching more */
+			goto exe;
+		}
+		for (xord_t o;
+		     !oq_full(&oq) && !NOT_A_XORD_P(o = yield_ord(stdin));
+		     oq_push(&oq, o));
+		if (!oq_full(&oq)) {
+			/* out of orders, shut him up */
+			fclose(stdin);
+			stdin = NULL;
+		}
+
+	exe:
+		if (NOT_A_XQUO_P(q)) {
+			/* no more quotes, everything's due */
+			q.o.t = NATV;
+		}
+		/* go through orders that became due and try exec'ing @q,
+		 * park what's left */
+		for (size_t nd = oq_due(&oq, q.o.t); nd; nd--, oq.i++) {
+			pord_t o = {*oq_at(&oq, oq.i), seq++, 0U, 0U};
+			const size_t v = s.ver[ao(o.x.o, s.a).sid];
+
+			/* expire what's timed out before O arrives */
+			xp_fire(&s, &xp, o.x.o.t);
+			if (UNLIKELY(o.x.tif == TIF_GTT && o.x.exp < o.x.o.t)) {
+				/* dead on arrival */
+				rest(&s, o.x.o.t, &o.x, false);
+				retire(&o.x);
+			} else if (_glob_coal && nd > 1U &&
+				   coal_p(&o.x, oq_at(&oq, oq.i + 1U))) {
+				/* walk the book once for O and its likes */
+				o.ver = v;
+				cq.n = 0U;
+				rc |= pq_add(&cq, o);
+				do {
+					nd--, oq.i++;
+					o = (pord_t){*oq_at(&oq, oq.i), seq++, 0U, v};
+					rc |= pq_add(&cq, o);
+				} while (nd > 1U &&
+					 coal_p(&o.x, oq_at(&oq, oq.i + 1U)));
+				exen(&s, cq.o, cq.n);
+				for (size_t i = 0U; i < cq.n; i++) {
+					if (cq.o[i].x.o.qty > 0.dd) {
+						rc |= settle(&s, &xp, mq, lq,
+							     cq.o[i]);
+					} else {
+						retire(&cq.o[i].x);
+					}
+				}
+			} else if (exe1(&s, &o.x)) {
+				retire(&o.x);
+			} else {
+				o.ver = v;
+				rc |= settle(&s, &xp, mq, lq, o);
+			}
+		}
+		if (q.o.t == NATV) {
+			if (s.a.base.m) {
+				/* flatten with a CANCEL order */
+				const ord_t o = {
+					ORD_MKT, BOOK_SIDE_CLR,
+					.qty = 0.dd, .lmt = NANPX, .t = s.metr
+				};
+				xord_t x = (xord_t){.o = o, .ins = cont, .inz = conz};
+
+				(void)exe1(&s, &x);
+			}
+			if (_glob_emit & EMIT_FIN) {
+				/* final account, after flattening */
+				push_acc(s.metr, s.a);
+			}
+			break;
+		}
+		oq_gc(&oq);
+		if (UNLIKELY(stdin == NULL)) {
+			/* order file is eof'd, skip fetching more */
+			;
+		} else if (oq_empty(&oq) ||
+			   oq_tat(&oq, oq.n - 1U) < q.o.t) {
+			/* there could be more orders between then and Q
+			 * try exec'ing those as well if there's room */
+			if (!oq_full(&oq) || !oq_grow(&oq)) {
+				goto ord;
+			}
+		}
+
+		/* expire what's timed out before the book changes,
+		 * and clean up once the dead outnumber the living */
+		xp_fire(&s, &xp, q.o.t);
+		if (UNLIKELY(xp.nzomb > 64U)) {
+			size_t n = 0U;
+
+			for (size_t j = 0U; j < countof(mq); j++) {
+				n += mq[j].n + lq[j].n;
+			}
+			if (2U * xp.nzomb > n) {
+				for (size_t j = 0U; j < countof(mq); j++) {
+					pq_sweep(mq + j, &xp, false);
+					pq_sweep(lq + j, &xp, true);
+				}
+			}
+		}
+		if (_glob_mtm) {
+			/* snapshots before the book changes */
+			s.mtmg = mtm(s.mtmg, q.o.t, s.a, s.b);
+		}
+		/* at last build up new book */
+		sim_add(&s, q.o);
+		if (q.r.s) {
+			sim_add(&s, q.r);
+		}
+	}
+	if (oq.o != oq._o) {
+		free(oq.o);
+	}
+	free(xp.k);
+	free(xp.t);
+	free_pq(&cq);
+	for (size_t j = 0U; j < countof(mq); j++) {
+		free_pq(mq + j);
+		free_pq(lq + j);
+	}
+	free_book(s.b);
+	return -(rc < 0);
 }
 
 
+static tv_t
+strtodur(const char *str)
+{
+/* read a duration, in seconds or suffixed by a unit,
+ * return NATV if STR can't be read */
+	char *on;
+	tv_t r;
+
+	if (UNLIKELY((r = strtotv(str, &on)) == NATV)) {
+		return NATV;
+	}
+	switch (*on++) {
+	secs:
+	case '\0':
+	case 'S':
+	case 's':
+		/* seconds but strtotv() gives us nanos already */
+		break;
+
+	case 'n':
+	case 'N':
+		switch (*on) {
+		case 's':
+		case 'S':
+			r /= NSECS;
+			break;
+		default:
+			goto invalid;
+		}
+		break;
+
+	case 'm':
+	case 'M':
+		switch (*on) {
+		case '\0':
+			/* they want minutes, oh oh */
+			r *= 60UL;
+			goto secs;
+		case 's':
+		case 'S':
+			/* milliseconds it is then */
+			r /= MSECS;
+			break;
+		default:
+			goto invalid;
+		}
+		break;
+
+	case 'h':
+	case 'H':
+		r *= 60U * 60U;
+		goto secs;
+
+	case 'u':
+	case 'U':
+		switch (*on) {
+		case 's':
+		case 'S':
+			on++;
+			r /= USECS;
+			break;
+		default:
+			goto invalid;
+		}
+		break;
+
+	default:
+	invalid:
+		return NATV;
+	}
+	return r;
+}
+
 #include "sex.yucc"
 
 int
@@ -473,6 +2240,10 @@ main(int argc, char *argv[])
 	static yuck_t argi[1U];
 	int rc = 0;
 	FILE *qfp;
+	pthread_t wt;
+	int ofd = STDOUT_FILENO;
+	bool ogz = false;
+	size_t smem = 0U;
 
 	if (yuck_parse(argi, argc, argv) < 0) {
 		rc = 1;
@@ -485,74 +2256,45 @@ Error: QUOTES file is mandatory.");
 	}
 
 	if (argi->exe_delay_arg) {
-		char *on;
-
-		_glob_age = strtotv(argi->exe_delay_arg, &on);
-		if (UNLIKELY(_glob_age == NATV)) {
+		if (UNLIKELY((_glob_age = strtodur(argi->exe_delay_arg)) == NATV)) {
 			errno = 0, serror("\
-Error: cannot read exe-delay argument");
+Error: invalid exe-delay, must be N with suffix `s', `ms', `us', `ns'");
 			rc = 1;
 			goto out;
 		}
-		switch (*on++) {
-		secs:
-		case '\0':
-		case 'S':
-		case 's':
-			/* seconds but strtotv() gives us nanos already */
-			break;
-
-		case 'n':
-		case 'N':
-			switch (*on) {
-			case 's':
-			case 'S':
-				_glob_age /= NSECS;
-				break;
-			default:
-				goto invalid;
-			}
-			break;
+	}
 
-		case 'm':
-		case 'M':
-			switch (*on) {
-			case '\0':
-				/* they want minutes, oh oh */
-				_glob_age *= 60UL;
-				goto secs;
-			case 's':
-			case 'S':
-				/* milliseconds it is then */
-				_glob_age /= MSECS;
-				break;
-			default:
-				goto invalid;
-			}
-			break;
+	if (argi->max_order_age_arg) {
+		if (UNLIKELY((_glob_maxage =
+			      strtodur(argi->max_order_age_arg)) == NATV ||
+			     !_glob_maxage)) {
+			errno = 0, serror("\
+Error: invalid max-order-age, must be N with suffix `s', `ms', `us', `ns'");
+			rc = 1;
+			goto out;
+		}
+	}
 
-		case 'h':
-		case 'H':
-			_glob_age *= 60U * 60U;
-			goto secs;
+	if (argi->retry_arg && argi->retry_arg != YUCK_OPTARG_NONE) {
+		/* retries are bounded like order ages, only in millis */
+		char *on;
+		tv_t r = strtoul(argi->retry_arg, &on, 10);
 
-		case 'u':
-		case 'U':
-			switch (*on) {
-			case 's':
-			case 'S':
-				on++;
-				_glob_age /= USECS;
-				break;
-			default:
-				goto invalid;
-			}
-			break;
+		if (UNLIKELY(!r || *on)) {
+			errno = 0, serror("\
+Error: invalid retry time, must be N milliseconds");
+			rc = 1;
+			goto out;
+		}
+		r *= NSECS / MSECS;
+		_glob_maxage = _glob_maxage && _glob_maxage < r ? _glob_maxage : r;
+	}
 
-		default:
-		invalid:
+	if (argi->mtm_arg) {
+		if (UNLIKELY((_glob_mtm = strtodur(argi->mtm_arg)) == NATV ||
+			     !_glob_mtm)) {
 			errno = 0, serror("\
-Error: invalid suffix to exe-dealy, must be `s', `ms', `us', `ns'");
+Error: invalid mtm interval, must be N with suffix `s', `ms', `us', `ns'");
 			rc = 1;
 			goto out;
 		}
@@ -583,6 +2325,162 @@ Error: commission must be given as PXb[/PXt]");
 		_glob_qty = strtoqx(argi->quantity_arg, NULL);
 	}
 
+	_glob_summ = argi->summary_flag;
+	_glob_noeffs = argi->no_effspread_flag;
+	_glob_maxq = argi->maxqty_flag;
+	_glob_absq = argi->absqty_flag;
+
+	if (argi->coalesce_arg == YUCK_OPTARG_NONE) {
+		_glob_coal = COAL_FIFO;
+	} else if (argi->coalesce_arg) {
+		static const char *coals[] = {
+			[COAL_FIFO] = "fifo",
+			[COAL_PRORATA] = "pro-rata",
+		};
+
+		for (_glob_coal = COAL_FIFO;
+		     _glob_coal < countof(coals); _glob_coal++) {
+			if (!strcmp(argi->coalesce_arg, coals[_glob_coal])) {
+				break;
+			}
+		}
+		if (_glob_coal >= countof(coals)) {
+			errno = 0, serror("\
+Error: coalesce allocation must be one of `fifo', `pro-rata'");
+			rc = 1;
+			goto out;
+		}
+	}
+
+	if (argi->emit_arg) {
+		static const char *emits[] = {
+			"exe", "acc", "final", "exp",
+		};
+		const char *on = argi->emit_arg;
+
+		_glob_emit = 0U;
+		for (const char *eo; *on; on = eo + (*eo == ',')) {
+			size_t i;
+
+			eo = strchr(on, ',') ?: on + strlen(on);
+			for (i = 0U; i < countof(emits); i++) {
+				if (eo - on == (ptrdiff_t)strlen(emits[i]) &&
+				    !memcmp(on, emits[i], eo - on)) {
+					_glob_emit |= 1U << i;
+					break;
+				}
+			}
+			if (i >= countof(emits) &&
+			    (eo - on != 4 || memcmp(on, "none", 4U))) {
+				errno = 0, serror("\
+Error: emit must be a list of `exe', `acc', `final', `exp', or `none'");
+				rc = 1;
+				goto out;
+			}
+		}
+	}
+
+	if (argi->fixed_arg) {
+		const char *on = argi->fixed_arg;
+
+		_glob_fixw = on != YUCK_OPTARG_NONE ? strtoul(on, NULL, 10) : 24U;
+		if (_glob_fixw < 4U || _glob_fixw > 64U) {
+			errno = 0, serror("\
+Error: field width must be between 4 and 64");
+			rc = 1;
+			goto out;
+		}
+	}
+
+	if (argi->sort_orders_arg == YUCK_OPTARG_NONE) {
+		smem = OSORTMEM;
+	} else if (argi->sort_orders_arg) {
+		char *on;
+
+		switch ((smem = strtoul(argi->sort_orders_arg, &on, 10)), *on) {
+		case 'G':
+		case 'g':
+			smem <<= 30U;
+			on++;
+			break;
+		case 'M':
+		case 'm':
+			smem <<= 20U;
+			on++;
+			break;
+		case 'K':
+		case 'k':
+			smem <<= 10U;
+			on++;
+			break;
+		default:
+			break;
+		}
+		if (!smem || *on) {
+			errno = 0, serror("\
+Error: invalid sort memory, must be N with suffix `k', `M', `G'");
+			rc = 1;
+			goto out;
+		}
+	}
+
+	if (argi->output_arg) {
+		const char *fn = argi->output_arg;
+		const size_t fz = strlen(fn);
+
+		if (fz > 4U && !strcmp(fn + fz - 4U, ".zst")) {
+			errno = 0, serror("\
+Error: zstd output is not supported, use .gz");
+			rc = 1;
+			goto out;
+		}
+		ogz = fz > 3U && !strcmp(fn + fz - 3U, ".gz");
+#if !defined HAVE_ZLIB
+		if (ogz) {
+			/* before FN is truncated */
+			errno = 0, serror("\
+Error: gzip output is not supported in this build");
+			rc = 1;
+			goto out;
+		}
+#endif	/* !HAVE_ZLIB */
+		if ((ofd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+			serror("\
+Error: cannot open output file `%s'", fn);
+			rc = 1;
+			goto out;
+		}
+	}
+
+	with (flush_t f = isatty(ofd) ? FLUSH_LINE : FLUSH_BLOCK) {
+		static const char *flushs[] = {
+			[FLUSH_BLOCK] = "block",
+			[FLUSH_LINE] = "line",
+			[FLUSH_IVAL] = "interval",
+		};
+
+		if (argi->flush_arg) {
+			for (f = FLUSH_BLOCK; f < countof(flushs); f++) {
+				if (!strcmp(argi->flush_arg, flushs[f])) {
+					break;
+				}
+			}
+			if (f >= countof(flushs)) {
+				errno = 0, serror("\
+Error: flush policy must be one of `line', `block', `interval'");
+				rc = 1;
+				goto out;
+			}
+		}
+		out = !ogz ? make_sink(ofd, OBUF, f) : make_gzsink(ofd, OBUF, f);
+		if (UNLIKELY(out == NULL)) {
+			serror("\
+Error: cannot allocate output buffer");
+			rc = 1;
+			goto out;
+		}
+	}
+
 	if (UNLIKELY((qfp = fopen(*argi->args, "r")) == NULL)) {
 		serror("\
 Error: cannot open QUOTES file `%s'", *argi->args);
@@ -596,11 +2494,63 @@ Error: cannot open QUOTES file `%s'", *argi->args);
 		conx = hash(cont, conz);
 	}
 
-	/* read orders from stdin, quotes from QFP and execute */
+	if (smem && UNLIKELY((osrt = make_osort(stdin, smem)) == NULL)) {
+		serror("\
+Error: cannot sort orders");
+		rc = 1;
+		goto clo;
+	}
+
+	if (_glob_fixw) {
+		/* every record gets the same width, leave room for
+		 * fields that overflow before they're replaced */
+		recw = fixrecw();
+		orec = recw + OREC;
+	}
+
+	if (UNLIKELY((evq = make_ring(NEVQ, sizeof(ev_t))) == NULL)) {
+		serror("\
+Error: cannot allocate event queue");
+		rc = 1;
+		goto clo;
+	} else if (UNLIKELY(errno = pthread_create(&wt, NULL, writer, NULL))) {
+		serror("\
+Error: cannot start writer thread");
+		rc = 1;
+		goto fre;
+	}
+
+	/* read orders from stdin, quotes from QFP and execute,
+	 * formatting and writing happens in the writer thread */
 	rc = offline(qfp) < 0;
 
+	ring_close(evq);
+	pthread_join(wt, NULL);
+	if (_glob_summ) {
+		/* the writer's gone, we can use the sink directly */
+		send_sum(summ);
+	}
+	/* values lost to narrow fixed-width fields fail the run */
+	rc |= fldovf;
+fre:
+	free_ring(evq);
+clo:
 	fclose(qfp);
 out:
+	if (out != NULL && free_sink(out) < 0) {
+		serror("\
+Error: cannot write output");
+		rc = 1;
+	}
+	if (ofd > STDOUT_FILENO && close(ofd) < 0) {
+		serror("\
+Error: cannot close output file");
+		rc = 1;
+	}
+	if (osrt != NULL) {
+		free_osort(osrt);
+	}
+	free_stash();
 	yuck_free(argi);
 	return rc;
 }
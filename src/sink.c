@@ -0,0 +1,354 @@
+/*** sink.c -- buffered output
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of sex.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#if defined HAVE_ZLIB
+# include <pthread.h>
+# include <zlib.h>
+#endif	/* HAVE_ZLIB */
+#include "sink.h"
+#include "nifty.h"
+
+struct sink_s {
+	int fd;
+	flush_t f;
+	/* time of the last flush, FLUSH_IVAL only */
+	uint64_t t;
+	size_t len;
+	size_t bsz;
+	char *buf;
+	/* set on the first failed write, nothing is written after that */
+	bool err;
+	/* compressor, if any */
+	struct zsnk_s *z;
+};
+
+
+static uint64_t
+now(void)
+{
+	struct timespec tsp;
+
+	if (UNLIKELY(clock_gettime(CLOCK_MONOTONIC, &tsp) < 0)) {
+		return 0ULL;
+	}
+	return tsp.tv_sec * 1000000000ULL + tsp.tv_nsec;
+}
+
+static int
+xwrite(int fd, const char *buf, size_t len)
+{
+	for (size_t tot = 0U; tot < len;) {
+		ssize_t nwr = write(fd, buf + tot, len - tot);
+
+		if (LIKELY(nwr > 0)) {
+			tot += nwr;
+		} else if (nwr < 0 && errno == EINTR) {
+			continue;
+		} else {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+sink_t
+make_sink(int fd, size_t bsz, flush_t f)
+{
+	sink_t s;
+
+	if (UNLIKELY((s = malloc(sizeof(*s))) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((s->buf = malloc(bsz)) == NULL)) {
+		free(s);
+		return NULL;
+	}
+	s->fd = fd;
+	s->f = f;
+	s->t = f == FLUSH_IVAL ? now() : 0ULL;
+	s->len = 0U;
+	s->bsz = bsz;
+	s->err = false;
+	s->z = NULL;
+	return s;
+}
+
+
+#if defined HAVE_ZLIB
+/* gzip compression, a helper thread deflates one buffer while the
+ * sink fills the other */
+struct zsnk_s {
+	pthread_t th;
+	pthread_mutex_t mtx;
+	pthread_cond_t go;
+	pthread_cond_t done;
+	z_stream zs;
+	/* buffer handed to the compressor, and the deflate() flush mode */
+	char *in;
+	size_t inz;
+	int mode;
+	bool busy;
+	bool quit;
+	bool err;
+	/* the sink's other buffer */
+	char *spare;
+	char out[256U * 1024U];
+};
+
+static void*
+deflater(void *clo)
+{
+	sink_t s = clo;
+	struct zsnk_s *z = s->z;
+
+	pthread_mutex_lock(&z->mtx);
+	while (1) {
+		while (!z->busy && !z->quit) {
+			pthread_cond_wait(&z->go, &z->mtx);
+		}
+		if (!z->busy) {
+			break;
+		}
+		pthread_mutex_unlock(&z->mtx);
+
+		z->zs.next_in = (unsigned char*)z->in;
+		z->zs.avail_in = z->inz;
+		do {
+			z->zs.next_out = (unsigned char*)z->out;
+			z->zs.avail_out = sizeof(z->out);
+			(void)deflate(&z->zs, z->mode);
+			with (size_t nz = sizeof(z->out) - z->zs.avail_out) {
+				if (!z->err && xwrite(s->fd, z->out, nz) < 0) {
+					z->err = true;
+				}
+			}
+		} while (!z->zs.avail_out);
+
+		pthread_mutex_lock(&z->mtx);
+		z->busy = false;
+		pthread_cond_signal(&z->done);
+	}
+	pthread_mutex_unlock(&z->mtx);
+	return NULL;
+}
+
+static int
+zflush(sink_t s, int mode)
+{
+	struct zsnk_s *z = s->z;
+	int rc;
+
+	pthread_mutex_lock(&z->mtx);
+	while (z->busy) {
+		pthread_cond_wait(&z->done, &z->mtx);
+	}
+	rc = -(int)z->err;
+	/* hand over the current buffer, continue in the spare one */
+	z->in = s->buf;
+	z->inz = s->len;
+	z->mode = mode;
+	z->busy = true;
+	s->buf = z->spare;
+	z->spare = z->in;
+	pthread_cond_signal(&z->go);
+	pthread_mutex_unlock(&z->mtx);
+	s->len = 0U;
+	return rc;
+}
+
+static int
+zfree(sink_t s)
+{
+	struct zsnk_s *z = s->z;
+	int rc = zflush(s, Z_FINISH);
+
+	pthread_mutex_lock(&z->mtx);
+	while (z->busy) {
+		pthread_cond_wait(&z->done, &z->mtx);
+	}
+	rc |= -(int)z->err;
+	z->quit = true;
+	pthread_cond_signal(&z->go);
+	pthread_mutex_unlock(&z->mtx);
+	pthread_join(z->th, NULL);
+
+	deflateEnd(&z->zs);
+	pthread_cond_destroy(&z->done);
+	pthread_cond_destroy(&z->go);
+	pthread_mutex_destroy(&z->mtx);
+	free(z->spare);
+	free(z);
+	s->z = NULL;
+	return rc;
+}
+
+sink_t
+make_gzsink(int fd, size_t bsz, flush_t f)
+{
+	struct zsnk_s *z;
+	sink_t s;
+
+	if (UNLIKELY((s = make_sink(fd, bsz, f)) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((z = calloc(1U, sizeof(*z))) == NULL)) {
+		goto nop;
+	} else if (UNLIKELY((z->spare = malloc(bsz)) == NULL)) {
+		goto nop;
+	}
+	/* gzip header, favour speed over ratio */
+	if (UNLIKELY(deflateInit2(&z->zs, Z_BEST_SPEED, Z_DEFLATED,
+				  15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)) {
+		goto nop;
+	}
+	pthread_mutex_init(&z->mtx, NULL);
+	pthread_cond_init(&z->go, NULL);
+	pthread_cond_init(&z->done, NULL);
+	s->z = z;
+	if (UNLIKELY(pthread_create(&z->th, NULL, deflater, s))) {
+		deflateEnd(&z->zs);
+		pthread_cond_destroy(&z->done);
+		pthread_cond_destroy(&z->go);
+		pthread_mutex_destroy(&z->mtx);
+		goto nop;
+	}
+	return s;
+
+nop:
+	if (z != NULL) {
+		free(z->spare);
+		free(z);
+	}
+	free(s->buf);
+	free(s);
+	return NULL;
+}
+
+#else  /* !HAVE_ZLIB */
+sink_t
+make_gzsink(int UNUSED(fd), size_t UNUSED(bsz), flush_t UNUSED(f))
+{
+	errno = ENOSYS;
+	return NULL;
+}
+#endif	/* HAVE_ZLIB */
+
+
+int
+free_sink(sink_t s)
+{
+	int rc;
+
+#if defined HAVE_ZLIB
+	if (s->z != NULL) {
+		rc = zfree(s);
+	} else
+#endif	/* HAVE_ZLIB */
+	rc = sink_flush(s);
+	rc |= -(int)s->err;
+	free(s->buf);
+	free(s);
+	return rc;
+}
+
+int
+sink_flush(sink_t s)
+{
+#if defined HAVE_ZLIB
+	if (s->z != NULL) {
+		/* keep the stream readable unless we flush for space */
+		const bool full = s->f == FLUSH_BLOCK;
+		return zflush(s, full ? Z_NO_FLUSH : Z_SYNC_FLUSH);
+	}
+#endif	/* HAVE_ZLIB */
+	if (!s->err && UNLIKELY(xwrite(s->fd, s->buf, s->len) < 0)) {
+		s->err = true;
+	}
+	s->len = 0U;
+	return -(int)s->err;
+}
+
+char*
+sink_get(sink_t s, size_t n)
+{
+	if (UNLIKELY(s->len + n > s->bsz)) {
+		sink_flush(s);
+	}
+	return s->buf + s->len;
+}
+
+int
+sink_idle(sink_t s)
+{
+	if (s->f != FLUSH_IVAL || !s->len) {
+		return 0;
+	}
+	s->t = now();
+	return sink_flush(s);
+}
+
+void
+sink_put(sink_t s, size_t n)
+{
+	s->len += n;
+	switch (s->f) {
+	case FLUSH_LINE:
+		sink_flush(s);
+		break;
+	case FLUSH_IVAL:
+		with (uint64_t t = now()) {
+			if (t - s->t >= SINK_IVAL) {
+				sink_flush(s);
+				s->t = t;
+			}
+		}
+		break;
+	case FLUSH_BLOCK:
+	default:
+		break;
+	}
+	return;
+}
+
+/* sink.c ends here */
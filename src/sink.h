@@ -0,0 +1,94 @@
+/*** sink.h -- buffered output
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of sex.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **/
+#if !defined INCLUDED_sink_h_
+#define INCLUDED_sink_h_
+#include <stddef.h>
+
+typedef enum {
+	/** flush when the buffer is full */
+	FLUSH_BLOCK,
+	/** flush after every record */
+	FLUSH_LINE,
+	/** flush when the buffer is full or at least every SINK_IVAL ns */
+	FLUSH_IVAL,
+} flush_t;
+
+#define SINK_IVAL	(100000000ULL)
+
+typedef struct sink_s *sink_t;
+
+/**
+ * Return a new sink writing to file descriptor FD through a buffer
+ * of BSZ bytes using flush policy F. */
+extern sink_t make_sink(int fd, size_t bsz, flush_t f);
+
+/**
+ * Like make_sink() but gzip the output in a helper thread, the buffer
+ * being deflated and written while the next one fills.
+ * Line and interval flushes produce sync points in the gzip stream.
+ * Return NULL and set errno to ENOSYS if built without zlib. */
+extern sink_t make_gzsink(int fd, size_t bsz, flush_t f);
+
+/**
+ * Flush and free sink S, the file descriptor is left open.
+ * Return 0 if all data put into S has been written, -1 otherwise. */
+extern int free_sink(sink_t s);
+
+/**
+ * Return a pointer to at least N bytes of free space in S.
+ * N must not exceed the sink's buffer size. */
+extern char *sink_get(sink_t s, size_t n);
+
+/**
+ * Commit N bytes written to the space obtained by sink_get() as one
+ * record and apply the flush policy. */
+extern void sink_put(sink_t s, size_t n);
+
+/**
+ * Write all buffered data to the sink's file descriptor.
+ * Return 0 on success and -1 on error, in which case the buffered
+ * data is discarded.  Errors are sticky, once a write has failed
+ * nothing more is written and every flush returns -1. */
+extern int sink_flush(sink_t s);
+
+/**
+ * Tell S that no records have come in for a while, under FLUSH_IVAL
+ * this writes out what is buffered.  Return like sink_flush(), or 0
+ * if there was nothing to write. */
+extern int sink_idle(sink_t s);
+
+#endif	/* INCLUDED_sink_h_ */
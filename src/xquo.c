@@ -61,6 +61,7 @@
 #endif
 #define strtoqx		strtod64
 #define qxtostr		d64tostr
+#define NANQX		NAND64
 
 #define NSECS	(1000000000)
 #define USECS	(1000000)
@@ -130,29 +131,73 @@ out:
 	return r;
 }
 
+static const char dig2[200U] =
+	"00010203040506070809" "10111213141516171819"
+	"20212223242526272829" "30313233343536373839"
+	"40414243444546474849" "50515253545556575859"
+	"60616263646566676869" "70717273747576777879"
+	"80818283848586878889" "90919293949596979899";
+
+static inline void
+putdig(char *restrict ep, long unsigned int m, size_t nd)
+{
+/* write the ND least significant digits of M so they end just before EP */
+	for (; nd >= 2U; nd -= 2U, m /= 100U) {
+		ep -= 2U;
+		memcpy(ep, dig2 + 2U * (m % 100U), 2U);
+	}
+	if (nd) {
+		*--ep = (char)((m % 10U) ^ '0');
+	}
+	return;
+}
+
+static size_t
+sectostr(char *restrict buf, long unsigned int ts)
+{
+/* write seconds TS, return the number of digits */
+	size_t n = 1U;
+
+	for (long unsigned int x = ts; x >= 10U; x /= 10U, n++);
+	putdig(buf + n, ts, n);
+	return n;
+}
+
 ssize_t
 tvtostr(char *restrict buf, size_t bsz, tv_t t)
 {
-	long unsigned int ts = t / NSECS;
-	long unsigned int tn = t % NSECS;
+	tvpfx_t c = {.n = 0U};
+	return tvtostr_r(buf, bsz, t, &c);
+}
+
+ssize_t
+tvtostr_r(char *restrict buf, size_t bsz, tv_t t, tvpfx_t *c)
+{
+	static const char naught[] = "0.000000000";
+	long unsigned int ts;
 	size_t i;
 
 	if (UNLIKELY(bsz < 19U)) {
 		return 0U;
+	} else if (!t) {
+		/* ages are 0 most of the time */
+		memcpy(buf, naught, strlenof(naught));
+		return strlenof(naught);
 	}
 
-	buf[0U] = '0';
-	for (i = !ts; ts > 0U; ts /= 10U, i++) {
-		buf[i] = (ts % 10U) ^ '0';
+	if (LIKELY((ts = t / NSECS) == c->s && c->n)) {
+		/* same second as last time, copy the lot, bsz is big enough */
+		memcpy(buf, c->b, sizeof(c->b));
+		i = c->n;
+	} else {
+		i = sectostr(buf, ts);
+		memcpy(c->b, buf, i);
+		c->s = ts;
+		c->n = i;
 	}
-	/* revert buffer */
-	for (char *bp = buf + i - 1, *ap = buf, tmp; bp > ap;
-	     tmp = *bp, *bp-- = *ap, *ap++ = tmp);
 	/* nanoseconds, fixed size */
 	buf[i] = '.';
-	for (size_t j = 9U; j > 0U; tn /= 10U, j--) {
-		buf[i + j] = (tn % 10U) ^ '0';
-	}
+	putdig(buf + i + 10U, t % NSECS, 9U);
 	return i + 10U;
 }
 
@@ -221,7 +266,7 @@ read_xquo(const char *line, size_t llen)
 	with (const char *p = on) {
 		q.o.q = strtoqx(p, &on);
 		if (UNLIKELY(p >= on)) {
-			q.o.q = NANPX;
+			q.o.q = NANQX;
 		}
 		on++;
 	}
@@ -244,6 +289,28 @@ read_xquo(const char *line, size_t llen)
 	return q;
 }
 
+static const char*
+read_tif(xord_t *restrict o, const char *on, const char *ep)
+{
+/* read the time-in-force field at ON, that is `IOC', `GTC' or `GTT='
+ * followed by the expiry, or nothing for GTC, return the beginning of
+ * whatever comes after, or NULL if the field is none of the above */
+	const char *eo = memchr(on, '\t', ep - on) ?: ep;
+	char *tp;
+
+	if (eo == on || eo - on == 3 && !memcmp(on, "GTC", 3U)) {
+		o->tif = TIF_GTC;
+	} else if (eo - on == 3 && !memcmp(on, "IOC", 3U)) {
+		o->tif = TIF_IOC;
+	} else if (eo - on > 4 && !memcmp(on, "GTT=", 4U) &&
+		   (o->exp = strtotv(on + 4U, &tp)) != NATV && tp == eo) {
+		o->tif = TIF_GTT;
+	} else {
+		return NULL;
+	}
+	return eo + (eo < ep);
+}
+
 xord_t
 read_xord(const char *ln, size_t lz)
 {
@@ -255,6 +322,8 @@ read_xord(const char *ln, size_t lz)
 	if (UNLIKELY(!lz)) {
 		goto bork;
 	}
+	o.tif = TIF_GTC, o.exp = NATV;
+	o.tag = NULL, o.tgz = 0U;
 
 	/* get timestamp */
 	o.o.t = strtotv(ln, &on);
@@ -306,11 +375,25 @@ read_xord(const char *ln, size_t lz)
 		/* nope */
 		goto bork;
 	} else if (*on++ == '\t') {
+		const char *lp = on;
+
 		o.o.lmt = strtopx(on, &on);
 		if (*on > ' ') {
 			goto bork;
+		} else if (on > lp) {
+			o.o.typ = ORD_LMT;
+		} else {
+			/* no limit, a market order with a time in force */
+			o.o.lmt = NANPX;
+			o.o.typ = ORD_MKT;
+		}
+		if (*on == '\t') {
+			/* time in force, possibly empty, and the rest is tag */
+			if ((o.tag = read_tif(&o, ++on, ep)) == NULL) {
+				goto bork;
+			}
+			o.tgz = ep - o.tag;
 		}
-		o.o.typ = ORD_LMT;
 	} else {
 		o.o.lmt = NANPX;
 		o.o.typ = ORD_MKT;
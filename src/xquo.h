@@ -76,14 +76,38 @@ typedef struct {
 
 	const char *ins;
 	size_t inz;
+
+	/* time in force, and the expiry for good-till-time orders */
+	enum {
+		TIF_GTC,
+		TIF_IOC,
+		TIF_GTT,
+	} tif;
+	tv_t exp;
+
+	/* opaque order tag, everything after the limit price
+	 * and the time in force */
+	const char *tag;
+	size_t tgz;
 } xord_t;
 
 #define NOT_A_XORD	((xord_t){NOT_A_ORD})
 #define NOT_A_XORD_P(x)	(NOT_A_ORD_P((x).o))
 
+/* last formatted seconds for tvtostr_r() */
+typedef struct {
+	tv_t s;
+	size_t n;
+	char b[16U];
+} tvpfx_t;
+
 
 extern tv_t strtotv(const char *ln, char **endptr);
 extern ssize_t tvtostr(char *restrict buf, size_t bsz, tv_t t);
+/**
+ * Like tvtostr() but reuse the seconds in C if they haven't changed
+ * since the last call, C should be zero-initialised before first use. */
+extern ssize_t tvtostr_r(char *restrict buf, size_t bsz, tv_t t, tvpfx_t *c);
 extern xquo_t read_xquo(const char *line, size_t llen);
 extern xord_t read_xord(const char *line, size_t llen);
 
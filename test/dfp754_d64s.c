@@ -0,0 +1,198 @@
+/*** dfp754_d64s.c -- batch conversions versus scalar ones
+ *
+ * Copyright (C) 2016-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of sex.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "dfp754_d64.h"
+
+#if !defined countof
+# define countof(x)	(sizeof(x) / sizeof(*x))
+#endif	/* !countof */
+
+/* fields for the parser, some aren't numbers, some are empty */
+static const char *const fld[] = {
+	"1.13325", "-0.00042", "abc", "", "100", "7x", "0.1234567",
+	"-3", "0", "-0.0", "999999999999999", "1.", ".5", "-", "+2",
+	"0.000000001", "12", "34",
+};
+
+
+static int
+fmteq(_Decimal64 x, _Decimal64 y)
+{
+/* compare X and Y through their string forms, so quanta count too */
+	char bx[64U], by[64U];
+	const int nx = d64tostr(bx, sizeof(bx), x);
+	const int ny = d64tostr(by, sizeof(by), y);
+
+	return nx == ny && !memcmp(bx, by, nx);
+}
+
+static int
+check_strtod64s(size_t n)
+{
+/* parse N fields, cycling through FLD, in one go and one by one */
+	char str[4096U];
+	size_t off[256U];
+	_Decimal64 tgt[255U];
+	size_t nok = 0U;
+	size_t r;
+	int rc = 0;
+
+	off[0U] = 0U;
+	for (size_t i = 0U; i < n; i++) {
+		const char *f = fld[i % countof(fld)];
+		const size_t z = strlen(f);
+
+		memcpy(str + off[i], f, z);
+		off[i + 1U] = off[i] + z;
+	}
+	/* junk right after the last field, must not be read */
+	memcpy(str + off[n], "9", 2U);
+
+	r = strtod64s(tgt, str, off, n);
+	for (size_t i = 0U; i < n; i++) {
+		const char *sp = str + off[i];
+		char *on;
+		_Decimal64 x = strtod64(sp, &on);
+
+		if (on > sp && on <= str + off[i + 1U]) {
+			nok++;
+		} else {
+			/* fields running into their neighbours are no good */
+			x = NAND64;
+		}
+		if (!fmteq(tgt[i], x)) {
+			fprintf(stderr, "\
+strtod64s(): field %zu of %zu `%.*s' differs\n",
+				i, n, (int)(off[i + 1U] - off[i]), sp);
+			rc = 1;
+		}
+	}
+	if (r != nok) {
+		fprintf(stderr, "\
+strtod64s(): %zu of %zu fields read, expected %zu\n", r, n, nok);
+		rc = 1;
+	}
+	return rc;
+}
+
+static int
+check_d64tostrs(void)
+{
+/* format everything in one go, then again into ever shorter buffers */
+	_Decimal64 src[40U];
+	size_t ref[countof(src) + 1U];
+	size_t off[countof(src) + 1U];
+	char want[1024U];
+	char buf[1024U];
+	size_t n = 0U;
+	size_t r;
+	int rc = 0;
+
+	src[n++] = NAND64;
+	src[n++] = INFD64;
+	src[n++] = -INFD64;
+	for (size_t i = 0U; n < countof(src); i++) {
+		src[n++] = strtod64(fld[i % countof(fld)], NULL);
+	}
+
+	/* what the scalar version makes of it */
+	ref[0U] = 0U;
+	for (size_t i = 0U; i < n; i++) {
+		const int z = d64tostr(want + ref[i], sizeof(want) - ref[i], src[i]);
+
+		want[ref[i] + z] = '\t';
+		ref[i + 1U] = ref[i] + z + 1U;
+	}
+
+	for (size_t bsz = ref[n] + 1U; bsz-- > 0U;) {
+		size_t k = n;
+
+		/* values whose separator still fits */
+		for (; ref[k] > bsz; k--);
+		memset(buf, '?', sizeof(buf));
+		r = d64tostrs(buf, bsz, off, src, n, '\t');
+		if (r != k || off[r] != ref[k]) {
+			fprintf(stderr, "\
+d64tostrs(): %zu values in %zu bytes, expected %zu\n", r, bsz, k);
+			rc = 1;
+			continue;
+		}
+		for (size_t i = 0U; i < r; i++) {
+			if (off[i] != ref[i]) {
+				fprintf(stderr, "\
+d64tostrs(): value %zu at %zu, expected %zu\n", i, off[i], ref[i]);
+				rc = 1;
+			}
+		}
+		if (memcmp(buf, want, ref[k])) {
+			fprintf(stderr, "\
+d64tostrs(): output in %zu bytes differs\n", bsz);
+			rc = 1;
+		}
+		/* nothing past BSZ may be touched */
+		for (size_t i = bsz; i < sizeof(buf); i++) {
+			if (buf[i] != '?') {
+				fprintf(stderr, "\
+d64tostrs(): wrote beyond %zu bytes\n", bsz);
+				rc = 1;
+				break;
+			}
+		}
+	}
+	return rc;
+}
+
+
+int
+main(void)
+{
+	int rc = 0;
+
+	/* less than, exactly and more than one batch */
+	rc |= check_strtod64s(0U);
+	rc |= check_strtod64s(countof(fld));
+	rc |= check_strtod64s(16U);
+	rc |= check_strtod64s(255U);
+	rc |= check_d64tostrs();
+	return rc;
+}
+
+/* dfp754_d64s.c ends here */